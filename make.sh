@@ -3,6 +3,7 @@
 
 SRC=("src/getbepis.c")
 OUT="bin/getbepis"
+LIBS=("-pthread")
 
 CC=${1:-$(which gcc)}
 shift
@@ -18,4 +19,4 @@ fi
 mkdir -p ${OUT%/*}
 
 # compile
-"$CC" ${CCARGS[@]} ${SRC[@]} -o "$OUT"
+"$CC" ${CCARGS[@]} ${SRC[@]} ${LIBS[@]} -o "$OUT"
@@ -9,9 +9,20 @@
 /*********************************************************************/
 
 #include <stdio.h>  /* printf, putc, fopen, fclose */
-#include <stdlib.h> /* calloc, free, NULL */
+#include <stdlib.h> /* calloc, free, aligned_alloc, NULL */
 #include <getopt.h> /* getopt_long, optarg, option */
-#include <string.h> /* strlen, strcpy */
+#include <string.h> /* strlen, strcpy, memset */
+#include <errno.h>  /* errno, EINTR */
+#include <time.h>   /* clock_gettime, timespec */
+#include <fcntl.h>  /* open, O_RDONLY */
+#include <pthread.h> /* pthread_create, pthread_join */
+#include <sys/mman.h> /* mmap, munmap, madvise */
+#include <sys/stat.h> /* fstat, lstat */
+#include <setjmp.h> /* jmp_buf, setjmp, longjmp */
+#include <signal.h> /* signal, SIGPIPE, SIG_IGN */
+#include <unistd.h> /* close, dup, unlink, sysconf */
+#include <sys/socket.h> /* socket, bind, listen, accept */
+#include <sys/un.h> /* sockaddr_un */
 
 
 
@@ -41,6 +52,8 @@ typedef int bool;
         (byte & 0x02 ? '1' : '0'),                                    \
         (byte & 0x01 ? '1' : '0')
 
+#define THREAD_LOCAL __thread
+
 /*********************************************************************/
 /* PRIVATE */               /* ENUMS */               /* ERROR CODES */
 /*********************************************************************/
@@ -53,12 +66,45 @@ typedef enum ERR_CODE
   ERR_CODE_BAD_MALLOC   = (1 <<  0) | ERR_CODE_FATAL,
   ERR_CODE_BAD_CLI      = (1 <<  1) | ERR_CODE_FATAL | ERR_CODE_USER_ERROR,
   ERR_CODE_BAD_FILE     = (1 <<  2) | ERR_CODE_FATAL,
-  ERR_CODE_BAD_TEST_NUM = (1 <<  3) | ERR_CODE_USER_ERROR
+  ERR_CODE_BAD_TEST_NUM = (1 <<  3) | ERR_CODE_USER_ERROR,
+  ERR_CODE_BAD_FORMAT   = (1 <<  4) | ERR_CODE_FATAL,
+  ERR_CODE_TEST_FAILED  = (1 <<  5)
 } ERR_CODE;
 
 static int g_CurrentErrors = 0;
 
+/* Any thrown code sharing a bit with this mask terminates (--fatal). */
+static int g_FatalMask        = (int)ERR_CODE_FATAL;
+static int g_FatalMaskDefault = (int)ERR_CODE_FATAL;
+
+typedef struct ErrorRecord
+{
+  ERR_CODE        code;
+  const char*     func;
+  unsigned        lineno;
+  struct timespec stamp;
+} ErrorRecord;
+
+#define ERROR_RING_CAPACITY 64
+
+/* Single-producer, single-consumer: only its own thread touches a ring. */
+typedef struct ErrorRing
+{
+  ErrorRecord records[ERROR_RING_CAPACITY];
+  unsigned    head;
+  unsigned    tail;
+  int         deferred;
+} ErrorRing;
+
+static THREAD_LOCAL ErrorRing g_ErrorRing;
+
+/* While set, Throw never terminates; fatal codes collect in the ring's
+   deferred mask until Errors_RaiseDeferred. Worker threads always defer,
+   and so does their spawner until every worker is joined. */
+static THREAD_LOCAL bool g_DeferFatal = FALSE;
+
 static void Throw(ERR_CODE code, const char* func, unsigned lineno);
+static void Errors_Drain(FILE* fout);
 
 
 
@@ -73,7 +119,19 @@ typedef enum OPT_CODE
   OPT_CODE_HELP     =  1,
   OPT_CODE_VERSION  =  2,
   OPT_CODE_OUTFILE  =  3,
-  OPT_CODE_HANG     =  4
+  OPT_CODE_HANG     =  4,
+  OPT_CODE_TEST     =  5,
+  OPT_CODE_SERVE    =  6,
+  OPT_CODE_DUMP     =  7,
+  OPT_CODE_FORMAT   =  8,
+  OPT_CODE_EXPAND   =  9,
+  OPT_CODE_BITSTATS = 10,
+  OPT_CODE_THREADS  = 11,
+  OPT_CODE_BITDIFF  = 12,
+  OPT_CODE_BITDIFF2 = 13,
+  OPT_CODE_RECORDS  = 14,
+  OPT_CODE_NUL      = 15,
+  OPT_CODE_WINDOW   = 16
 } OPT_CODE;
 
 
@@ -87,7 +145,8 @@ typedef void (*TestFunction)();
 typedef enum METAOBJECT_TYPE
 {
   METAOBJECT_TYPE_BSTRING           = 0,
-  METAOBJECT_TYPE_OPTION_INPUT      = 1
+  METAOBJECT_TYPE_OPTION_INPUT      = 1,
+  METAOBJECT_TYPE_COUNT             = 2
 } METAOBJECT_TYPE;
 
 typedef void (*Destructor) (void**);
@@ -143,6 +202,90 @@ typedef struct OptionInput
 
 
 
+/*********************************************************************/
+/* PRIVATE */              /* FUNCTIONS */             /* FORMATTING */
+/*********************************************************************/
+
+/* Fillers write into caller-owned memory and return the length written,
+   not counting the '\0' they always terminate with. */
+
+#define CSTRING_BINARY8_LENGTH  8
+#define CSTRING_BINARY32_LENGTH 35
+#define CSTRING_UINT_LENGTH     20
+
+static int CString_FillFromByte(char* buffer, unsigned char byte)
+{
+  int i;
+
+  for (i = 0; i < 8; ++i)
+  {
+    buffer[i] = (char)('0' + ((byte >> (7 - i)) & 0x01));
+  }
+
+  buffer[8] = '\0';
+  return CSTRING_BINARY8_LENGTH;
+}
+
+static int CString_FillFromInt32(char* buffer, unsigned uint32)
+{
+  CString_FillFromByte(buffer +  0, (unsigned char)(uint32 >> 24));
+  buffer[8]  = ' ';
+  CString_FillFromByte(buffer +  9, (unsigned char)(uint32 >> 16));
+  buffer[17] = ' ';
+  CString_FillFromByte(buffer + 18, (unsigned char)(uint32 >>  8));
+  buffer[26] = ' ';
+  CString_FillFromByte(buffer + 27, (unsigned char)(uint32 >>  0));
+  return CSTRING_BINARY32_LENGTH;
+}
+
+static int CString_FillFromUInt(char* buffer, unsigned long value)
+{
+  char digits[CSTRING_UINT_LENGTH];
+  int  count = 0;
+  int  i;
+
+  do
+  {
+    digits[count++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value);
+
+  for (i = 0; i < count; ++i)
+  {
+    buffer[i] = digits[count - 1 - i];
+  }
+
+  buffer[count] = '\0';
+  return count;
+}
+
+static void Sink_WriteBinary8(FILE* fout, unsigned char byte)
+{
+  char buffer[CSTRING_BINARY8_LENGTH + 1];
+  fwrite(buffer, 1, CString_FillFromByte(buffer, byte), fout);
+}
+
+static void Sink_WriteBinary32(FILE* fout, unsigned uint32)
+{
+  char buffer[CSTRING_BINARY32_LENGTH + 1];
+  fwrite(buffer, 1, CString_FillFromInt32(buffer, uint32), fout);
+}
+
+static void Sink_WriteUInt(FILE* fout, unsigned long value)
+{
+  char buffer[CSTRING_UINT_LENGTH + 1];
+  fwrite(buffer, 1, CString_FillFromUInt(buffer, value), fout);
+}
+
+static void Sink_WriteQuoted(FILE* fout, const char* str, size_t len)
+{
+  putc('"', fout);
+  fwrite(str, 1, len, fout);
+  putc('"', fout);
+}
+
+
+
 /*********************************************************************/
 /* PRIVATE */               /* STRUCTS */                 /* METHODS */
 /*********************************************************************/
@@ -162,6 +305,112 @@ static unsigned long SizeofMetaObject(METAOBJECT_TYPE type)
   return s_StructSizes[(int)type];
 }
 
+#define METAPOOL_CACHE_LINE 64
+#define METAPOOL_SLAB_BYTES 4096
+
+/* A slab is one cache-line-aligned block; objects start a line in. */
+typedef struct MetaSlab
+{
+  struct MetaSlab* next;
+} MetaSlab;
+
+typedef struct MetaPool
+{
+  MetaSlab*     slabs;
+  MetaObjectPtr free_list;
+} MetaPool;
+
+/* Each thread gets its own pools, so no locking: dispose objects on the
+   thread that created them. */
+static THREAD_LOCAL MetaPool g_MetaPools[METAOBJECT_TYPE_COUNT];
+
+static size_t MetaPool_Stride(METAOBJECT_TYPE type)
+{
+  return (SizeofMetaObject(type) + 15u) & ~(size_t)15u;
+}
+
+static bool MetaPool_Grow(MetaPool* pool, METAOBJECT_TYPE type)
+{
+  size_t    stride = MetaPool_Stride(type);
+  size_t    count  = (METAPOOL_SLAB_BYTES - METAPOOL_CACHE_LINE) / stride;
+  char*     cursor;
+  MetaSlab* slab   = (MetaSlab*)aligned_alloc(METAPOOL_CACHE_LINE,
+                                              METAPOOL_SLAB_BYTES);
+
+  if (!slab)
+  {
+    Throw(ERR_CODE_BAD_MALLOC, __FUNCTION__, __LINE__);
+    return FALSE;
+  }
+
+  slab->next  = pool->slabs;
+  pool->slabs = slab;
+
+  cursor = (char*)slab + METAPOOL_CACHE_LINE;
+
+  while (count --> 0)
+  {
+    MetaObjectPtr obj = (MetaObjectPtr)cursor;
+    obj->next         = pool->free_list;
+    pool->free_list   = obj;
+    cursor           += stride;
+  }
+
+  return TRUE;
+}
+
+/* Zeroed storage for one object of the given type, from its pool. */
+static void* MetaObject_Alloc(METAOBJECT_TYPE type)
+{
+  MetaPool*     pool = &g_MetaPools[(int)type];
+  MetaObjectPtr obj;
+
+  if (!pool->free_list && !MetaPool_Grow(pool, type))
+  {
+    return NULL;
+  }
+
+  obj             = pool->free_list;
+  pool->free_list = obj->next;
+
+  memset(obj, 0, MetaPool_Stride(type));
+  obj->type = type; /* so MetaObject_Free finds the pool before construction */
+  return obj;
+}
+
+static void MetaObject_Free(MetaObjectPtr obj)
+{
+  if (obj)
+  {
+    MetaPool* pool  = &g_MetaPools[(int)obj->type];
+    obj->next       = pool->free_list;
+    pool->free_list = obj;
+  }
+}
+
+static void MetaPool_Release(MetaPool* pool)
+{
+  while (pool->slabs)
+  {
+    MetaSlab* slab = pool->slabs;
+    pool->slabs    = slab->next;
+    free(slab);
+  }
+
+  pool->free_list = NULL;
+}
+
+/* Hands every slab of this thread back to the system. */
+static void MetaPools_Release()
+{
+  int i;
+
+  for (i = 0; i < METAOBJECT_TYPE_COUNT; ++i)
+  {
+    MetaPool_Release(&g_MetaPools[i]);
+  }
+}
+
 static void MetaData_Construct(MetaData*        metadata,
                                METAOBJECT_TYPE  type,
                                Destructor       dtor)
@@ -176,11 +425,12 @@ static void MetaData_Construct(MetaData*        metadata,
   }
 }
 
+/* Iterative, so lists of any length cannot overflow the stack. */
 static void MetaObject_Dispose(MetaObjectPtr obj)
 {
-  if (obj)
+  while (obj)
   {
-    MetaObject_Dispose(obj->next);
+    MetaObjectPtr next = obj->next;
 
     if (obj->dtor)
     {
@@ -188,8 +438,10 @@ static void MetaObject_Dispose(MetaObjectPtr obj)
     }
     else
     {
-      free(obj);
+      MetaObject_Free(obj);
     }
+
+    obj = next;
   }
 }
 
@@ -280,7 +532,7 @@ static bool BString_Construct(BString* ptr, const char* str, size_t len)
     }
     else
     {
-      ptr->size     = len + 1;
+      ptr->size     = len;
       ptr->capacity = len + 1;
 
       ptr->data = (char*)calloc(ptr->capacity, sizeof(char));
@@ -291,7 +543,7 @@ static bool BString_Construct(BString* ptr, const char* str, size_t len)
         return FALSE;
       }
 
-      strcpy(ptr->data, str);
+      memcpy(ptr->data, str, len);
     }
 
     return TRUE;
@@ -302,7 +554,7 @@ static bool BString_Construct(BString* ptr, const char* str, size_t len)
 
 static BString* BString_Create(const char* str, size_t len)
 {
-  BString* result = (BString*)calloc(1, sizeof(BString));
+  BString* result = (BString*)MetaObject_Alloc(METAOBJECT_TYPE_BSTRING);
 
   if (!result)
   {
@@ -313,7 +565,7 @@ static BString* BString_Create(const char* str, size_t len)
   if (!BString_Construct(result, str, len))
   {
     Throw(ERR_CODE_FATAL, __FUNCTION__, __LINE__);
-    free(result);
+    MetaObject_Free(&result->metadata);
     return NULL;
   }
 
@@ -331,7 +583,7 @@ static void BString_Dispose(void** vptr)
       free(bstring->data);
     }
 
-    free(*vptr);
+    MetaObject_Free(&bstring->metadata);
     *vptr = NULL;
   }
 }
@@ -340,20 +592,20 @@ static bool BString_GrowCapacity(BString* bstring, float growth_factor)
 {
   if (bstring && growth_factor > 1.0f)
   {
-    char*  old_array = bstring->data;
     size_t new_cap   = (size_t)((float)bstring->capacity * growth_factor);
+    char*  new_array = (char*)calloc(new_cap, sizeof(char));
 
-    bstring->data     = (char*)calloc(new_cap, sizeof(char));
-
-    if (!bstring->data)
+    /* On failure the string keeps its old array, as with BString_Reserve. */
+    if (!new_array)
     {
       Throw(ERR_CODE_BAD_MALLOC, __FUNCTION__, __LINE__);
       return FALSE;
     }
 
+    strcpy(new_array, bstring->data);
+    free(bstring->data);
+    bstring->data     = new_array;
     bstring->capacity = new_cap;
-    strcpy(bstring->data, old_array);
-    free(old_array);
     return TRUE;
   }
 
@@ -364,23 +616,112 @@ static void BString_PushBackChar(BString* bstring, char c)
 {
   if (bstring)
   {
-    if (bstring->size == bstring->capacity - 1)
+    if (bstring->size == bstring->capacity - 1 &&
+        !BString_GrowCapacity(bstring, BSTRING_DEFAULT_GROWTHFACTOR))
     {
-      BString_GrowCapacity(bstring, BSTRING_DEFAULT_GROWTHFACTOR);
+      return;
     }
 
     bstring->data[bstring->size++] = c;
   }
 }
 
+static void BString_Clear(BString* bstring)
+{
+  if (bstring && bstring->data)
+  {
+    memset(bstring->data, 0, bstring->capacity);
+    bstring->size = 0u;
+  }
+}
+
+/* Makes room for extra more chars (plus '\0') with at most one copy. */
+static bool BString_Reserve(BString* bstring, size_t extra)
+{
+  if (bstring)
+  {
+    size_t needed  = bstring->size + extra + 1;
+    size_t new_cap = bstring->capacity;
+    char*  new_array;
+
+    if (needed <= bstring->capacity)
+    {
+      return TRUE;
+    }
+
+    while (new_cap < needed)
+    {
+      new_cap = (size_t)((float)new_cap * BSTRING_DEFAULT_GROWTHFACTOR) + 1;
+    }
+
+    new_array = (char*)calloc(new_cap, sizeof(char));
+
+    if (!new_array)
+    {
+      Throw(ERR_CODE_BAD_MALLOC, __FUNCTION__, __LINE__);
+      return FALSE;
+    }
+
+    memcpy(new_array, bstring->data, bstring->size);
+    free(bstring->data);
+    bstring->data     = new_array;
+    bstring->capacity = new_cap;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void BString_Append(BString* bstring, const char* str, size_t len)
+{
+  if (BString_Reserve(bstring, len))
+  {
+    memcpy(bstring->data + bstring->size, str, len);
+    bstring->size += len;
+    bstring->data[bstring->size] = '\0';
+  }
+}
+
 static void BString_PushBackCString(BString* bstring, const char* cstring)
 {
-  int    i   = 0;
-  size_t len = strlen(cstring);
+  BString_Append(bstring, cstring, strlen(cstring));
+}
+
+static void BString_AppendBinary8(BString* bstring, unsigned char byte)
+{
+  if (BString_Reserve(bstring, CSTRING_BINARY8_LENGTH))
+  {
+    bstring->size += CString_FillFromByte(bstring->data + bstring->size, byte);
+  }
+}
+
+static void BString_AppendBinary32(BString* bstring, unsigned uint32)
+{
+  if (BString_Reserve(bstring, CSTRING_BINARY32_LENGTH))
+  {
+    bstring->size += CString_FillFromInt32(bstring->data + bstring->size, uint32);
+  }
+}
+
+static void BString_AppendUInt(BString* bstring, unsigned long value)
+{
+  if (BString_Reserve(bstring, CSTRING_UINT_LENGTH))
+  {
+    bstring->size += CString_FillFromUInt(bstring->data + bstring->size, value);
+  }
+}
 
-  while (i < len)
+static void BString_AppendQuoted(BString* bstring, const char* str, size_t len)
+{
+  if (BString_Reserve(bstring, len + 2))
   {
-    BString_PushBackChar(bstring, cstring[i++]);
+    char* write = bstring->data + bstring->size;
+
+    write[0] = '"';
+    memcpy(write + 1, str, len);
+    write[len + 1] = '"';
+    write[len + 2] = '\0';
+    bstring->size += len + 2;
   }
 }
 
@@ -388,7 +729,8 @@ static void BString_Print(BString* bstring, FILE* fout)
 {
   if (bstring)
   {
-    fprintf(fout, "\"%s\"_BString", bstring->data);
+    Sink_WriteQuoted(fout, bstring->data, bstring->size);
+    fputs("_BString", fout);
   }
 }
 
@@ -436,6 +778,16 @@ static void BString_TestMain(int argc, const char* argv[])
 
 static FILE* g_FileOut = NULL;
 
+/* The sink g_FileOut falls back to; --serve swaps it per connection. */
+static FILE* g_FileDefault = NULL;
+
+/* Where a fatal Throw lands while a --serve request is running. */
+static jmp_buf g_RequestJump;
+static THREAD_LOCAL bool g_InRequest = FALSE;
+
+/* Set while --serve takes its requests from stdin. */
+static bool g_ServingStdin = FALSE;
+
 static OptionInput g_Inputs[] =
 {
   // (no options)
@@ -448,6 +800,30 @@ static OptionInput g_Inputs[] =
   { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
   // --hang
   { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --test
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --serve
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --dump
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --out-format
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --expand
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --bitstats
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --threads
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --bitdiff (A)
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --bitdiff (B)
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --records
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --nul
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
+  // --window
+  { METAOBJECT_DEFAULT_STRUCT(METAOBJECT_TYPE_OPTION_INPUT), FALSE, NULL },
 };
 
 static MetaList g_NonOptionArgumentStrings = { NULL, 0 };
@@ -480,9 +856,19 @@ static int CTZ(int dword)
   return i16 + i8 + i4 + i2 + i1 + i0;
 }
 
+static int POPCNT(unsigned dword)
+{
+  dword = dword - ((dword >> 1) & 0x55555555u);
+  dword = (dword & 0x33333333u) + ((dword >> 2) & 0x33333333u);
+  dword = (dword + (dword >> 4)) & 0x0F0F0F0Fu;
+
+  return (int)((dword * 0x01010101u) >> 24);
+}
+
 static bool CurrentErrors_Contains(ERR_CODE code)
 {
-  return (g_CurrentErrors & (int)code) == (int)code;
+  int errors = __atomic_load_n(&g_CurrentErrors, __ATOMIC_RELAXED);
+  return (errors & (int)code) == (int)code;
 }
 
 static char* CString_NewFromByte(unsigned char byte)
@@ -494,7 +880,7 @@ static char* CString_NewFromByte(unsigned char byte)
     return NULL;
   }
 
-  result = (char*)calloc(9, sizeof(char));
+  result = (char*)calloc(CSTRING_BINARY8_LENGTH + 1, sizeof(char));
 
   if (!result)
   {
@@ -502,16 +888,11 @@ static char* CString_NewFromByte(unsigned char byte)
     return NULL;
   }
 
-  sprintf(result, BYTE_TO_BINARY_PATTERN, BYTE_TO_BINARY(byte));
+  CString_FillFromByte(result, byte);
 
   return result;
 }
 
-static int CString_FillFromByte(char* buffer, unsigned char byte)
-{
-  return sprintf(buffer, BYTE_TO_BINARY_PATTERN, BYTE_TO_BINARY(byte));
-}
-
 static char* CString_NewFromInt32(unsigned uint32)
 {
   char* result = NULL;
@@ -521,7 +902,7 @@ static char* CString_NewFromInt32(unsigned uint32)
     return NULL;
   }
 
-  result = (char*)calloc(36, sizeof(char));
+  result = (char*)calloc(CSTRING_BINARY32_LENGTH + 1, sizeof(char));
 
   if (!result)
   {
@@ -529,65 +910,120 @@ static char* CString_NewFromInt32(unsigned uint32)
     return NULL;
   }
 
-  sprintf(result, BYTE_TO_BINARY_PATTERN" "
-                  BYTE_TO_BINARY_PATTERN" "
-                  BYTE_TO_BINARY_PATTERN" "
-                  BYTE_TO_BINARY_PATTERN,
-                  BYTE_TO_BINARY(uint32 >> 24),
-                  BYTE_TO_BINARY(uint32 >> 16),
-                  BYTE_TO_BINARY(uint32 >>  8),
-                  BYTE_TO_BINARY(uint32 >>  0));
+  CString_FillFromInt32(result, uint32);
 
   return result;
 }
 
-static int CString_FillFromInt32(char* buffer, unsigned uint32)
+static void PrintHelp(FILE* fout)
+{
+  fprintf(fout, "Usage: ./getbepis.exe [options]\n"
+                "\n");
+
+  fprintf(fout, "Options:\n"
+                " -h  --help      Displays this help message.\n"
+                " -v  --version   Displays the versioning info.\n"
+                " -0  --hang      Hangs the fucking program by a noose.\n"
+                " -o  --out=FILE  Specifies a file to put bepis in.\n"
+                " -t  --test=NUM  Runs numbered tests.\n"
+                " -r  --records=FILE\n"
+                "                 Adds each line of FILE (\"-\" for stdin) as if it\n"
+                "                 were a non-option argument.\n"
+                " -z  --nul       Records in --records end in NUL, not newline.\n"
+                " -w  --window=N  Prints and frees --records every N records\n"
+                "                 instead of keeping them all.\n"
+                " -d  --dump=FILE Dumps the bits of FILE (\"-\" for stdin).\n"
+                " -F  --out-format=WHICH\n"
+                "                 Dump as \"text\" (default) or as \"packed\", a\n"
+                "                 compressed framing of the same dump.\n"
+                " -x  --expand=FILE\n"
+                "                 Expands a packed dump back into text.\n"
+                " -b  --bitstats=FILE\n"
+                "                 Reports bit, popcount, trailing-zero and byte\n"
+                "                 statistics of FILE's 32-bit little-endian words\n"
+                "                 (FILE must be a regular file).\n"
+                " -D  --bitdiff A B\n"
+                "                 Lists every byte offset where files A and B\n"
+                "                 differ, with both values and their XOR.\n"
+                " -j  --threads=N Worker threads for --bitstats and --bitdiff\n"
+                "                 (default: one per core).\n"
+                " -f  --fatal=WHICH\n"
+                "                 Which errors terminate: \"fatal\" (default),\n"
+                "                 \"user\" (also user errors) or \"all\".\n"
+                " -s  --serve[=SOCKET]\n"
+                "                 Reads one command line per line from stdin (or\n"
+                "                 from clients of the Unix socket SOCKET) and runs\n"
+                "                 each as its own request in this process. When\n"
+                "                 reading stdin, requests may not use \"-\" as the\n"
+                "                 FILE of --records, --dump or --expand.\n");
+}
+
+static void PrintVersion(FILE* fout)
 {
-  return sprintf(buffer,  BYTE_TO_BINARY_PATTERN" "
-                          BYTE_TO_BINARY_PATTERN" "
-                          BYTE_TO_BINARY_PATTERN" "
-                          BYTE_TO_BINARY_PATTERN,
-                          BYTE_TO_BINARY(uint32 >> 24),
-                          BYTE_TO_BINARY(uint32 >> 16),
-                          BYTE_TO_BINARY(uint32 >>  8),
-                          BYTE_TO_BINARY(uint32 >>  0));
+  fprintf(fout, "==== gEtbepIs.eXe ====\n"
+                "| Version 0.3.15\n"
+                "| Author    : Levi Perez (levi.perez@digipen.edu) AKA Pyr3z\n"
+                "| Date      : 2019-08-31\n"
+                "| Copyright : NONE; FUCK YOU\n");
 }
 
-static void PrintHelp()
+static void OptionInput_Set(OptionInput* input, const char* arg)
 {
-  printf( "Usage: ./getbepis.exe [options]\n"
-          "\n");
+  if (input)
+  {
+    input->input = TRUE;
+
+    if (input->optarg)
+    {
+      BString_Dispose((void**)&input->optarg);
+    }
 
-  printf( "Options:\n"
-          " -h  --help      Displays this help message.\n"
-          " -v  --version   Displays the versioning info.\n"
-          " -0  --hang      Hangs the fucking program by a noose.\n"
-          " -o  --out=FILE  Specifies a file to put bepis in.\n"
-          " -t  --test=NUM  Runs numbered tests.\n");
+    if (arg)
+    {
+      input->optarg = BString_Create(arg, strlen(arg));
+    }
+  }
 }
 
-static void PrintVersion()
+static void OptionInput_Reset(OptionInput* input)
 {
-  printf( "==== gEtbepIs.eXe ====\n"
-          "| Version 0.3.15\n"
-          "| Author    : Levi Perez (levi.perez@digipen.edu) AKA Pyr3z\n"
-          "| Date      : 2019-08-31\n"
-          "| Copyright : NONE; FUCK YOU\n");
+  if (input)
+  {
+    input->input = FALSE;
+
+    if (input->optarg)
+    {
+      BString_Dispose((void**)&input->optarg);
+    }
+  }
 }
 
 static void InitGlobalMemory(const char* argv0)
 {
-  g_FileOut = stdout;
+  if (!g_FileDefault)
+  {
+    g_FileDefault = stdout;
+  }
+
+  g_FileOut = g_FileDefault;
   MetaList_PushBack(&g_NonOptionArgumentStrings,
                     (MetaObjectPtr)BString_Create(argv0, strlen(argv0)));
 }
 
 static void FreeGlobalMemory()
 {
-  if (g_FileOut != NULL && g_FileOut != stdout)
+  size_t i;
+
+  if (g_FileOut != NULL && g_FileOut != stdout && g_FileOut != g_FileDefault)
   {
     fclose(g_FileOut);
-    g_FileOut = NULL;
+  }
+
+  g_FileOut = NULL;
+
+  for (i = 0; i < sizeof(g_Inputs) / sizeof(OptionInput); ++i)
+  {
+    OptionInput_Reset(&g_Inputs[i]);
   }
 
   MetaList_Clear(&g_NonOptionArgumentStrings);
@@ -595,7 +1031,16 @@ static void FreeGlobalMemory()
 
 static void Terminate()
 {
+  Errors_Drain(g_FileDefault);
+
+  if (g_InRequest)
+  {
+    /* --serve: fail only the current request, keep the process. */
+    longjmp(g_RequestJump, 1);
+  }
+
   FreeGlobalMemory();
+  MetaPools_Release();
   exit(g_CurrentErrors);
 }
 
@@ -603,10 +1048,11 @@ static void Hang()
 {
   FreeGlobalMemory();
   Throw(ERR_CODE_USER_ERROR, __FUNCTION__, __LINE__);
+  Errors_Drain(g_FileDefault);
   while (TRUE);
 }
 
-static void Throw(ERR_CODE code, const char* func, unsigned lineno)
+static const char* ErrCode_ToString(ERR_CODE code)
 {
   static const char* s_CodeToStringLookup[] =
   {
@@ -615,8 +1061,8 @@ static void Throw(ERR_CODE code, const char* func, unsigned lineno)
     "Command line input was invalid",
     "Unable to open file stream",
     "An invalid test number was passed to the --test or -t option.",
-    "<ERRORS WITHIN ERRORS>",
-    "<ERRORS WITHIN ERRORS>",
+    "Input data is not in the expected format",
+    "A numbered test failed one of its checks",
     "<ERRORS WITHIN ERRORS>",
     "<ERRORS WITHIN ERRORS>",
     "<ERRORS WITHIN ERRORS>",
@@ -646,75 +1092,1774 @@ static void Throw(ERR_CODE code, const char* func, unsigned lineno)
     "<ERRORS WITHIN ERRORS>"
   };
 
+  return s_CodeToStringLookup[CTZ((int)code) + 1];
+}
+
+/* Formats and clears everything this thread has thrown so far. */
+static void Errors_Drain(FILE* fout)
+{
   static const char* s_MsgFormat = "<ERR> %s"
                                     "\n      in func  \"%s\""
                                     "\n      on line  #%.4u"
-                                    "\n      ERR_CODE %s\n\n";
+                                    "\n      at time  %ld.%.9lds"
+                                    "\n      ERR_CODE ";
 
-  static char s_BinaryBuffer[36] = { 0 };
+  bool       user_error = FALSE;
+  ErrorRing* ring       = &g_ErrorRing;
 
-  if (code > ERR_CODE_NONE)
+  if (ring->head - ring->tail > ERROR_RING_CAPACITY)
   {
-    int idx = CTZ((int)code) + 1;
-    g_CurrentErrors |= (int)code;
-
-    CString_FillFromInt32(s_BinaryBuffer, (unsigned)code);
-
-    printf(s_MsgFormat, s_CodeToStringLookup[idx], func, lineno, s_BinaryBuffer);
+    fprintf(fout, "<ERR> %u older errors were dropped.\n\n",
+           ring->head - ring->tail - ERROR_RING_CAPACITY);
+    ring->tail = ring->head - ERROR_RING_CAPACITY;
   }
 
-  if (CurrentErrors_Contains(ERR_CODE_USER_ERROR))
+  while (ring->tail != ring->head)
   {
-    PrintHelp();
+    ErrorRecord* record = &ring->records[ring->tail++ % ERROR_RING_CAPACITY];
+
+    fprintf(fout, s_MsgFormat, ErrCode_ToString(record->code), record->func,
+           record->lineno, (long)record->stamp.tv_sec,
+           (long)record->stamp.tv_nsec);
+    Sink_WriteBinary32(fout, (unsigned)record->code);
+    fputs("\n\n", fout);
+
+    if ((int)record->code & (int)ERR_CODE_USER_ERROR)
+    {
+      user_error = TRUE;
+    }
   }
 
-  if (CurrentErrors_Contains(ERR_CODE_FATAL))
+  if (user_error)
   {
-    Terminate();
+    PrintHelp(fout);
   }
 }
 
-static void SetOutFile(const char* filename)
+static void ErrorRing_Push(const ErrorRecord* record)
 {
-  if (!filename)
-  {
-    g_FileOut = stdout;
-  }
-  else
+  g_ErrorRing.records[g_ErrorRing.head++ % ERROR_RING_CAPACITY] = *record;
+}
+
+/* Only records the error; formatting waits for Errors_Drain. */
+static void Throw(ERR_CODE code, const char* func, unsigned lineno)
+{
+  if (code != ERR_CODE_NONE)
   {
-    g_FileOut = fopen(filename, "w");
+    ErrorRecord record;
 
-    if (!g_FileOut)
+    record.code   = code;
+    record.func   = func;
+    record.lineno = lineno;
+    clock_gettime(CLOCK_MONOTONIC, &record.stamp);
+    ErrorRing_Push(&record);
+
+    __atomic_fetch_or(&g_CurrentErrors, (int)code, __ATOMIC_RELAXED);
+
+    if (g_DeferFatal)
     {
-      Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+      g_ErrorRing.deferred |= (int)code;
+    }
+    else if ((int)code & g_FatalMask)
+    {
+      Terminate();
     }
   }
 }
 
-static void BString_Test()
+/* Last thing a worker thread does: hands its records to whoever joins it. */
+static void Errors_Detach(ErrorRing* into)
 {
-  fprintf(g_FileOut, "/*********************************************************************/\n");
-  fprintf(g_FileOut, "/* BString_Test (--test=0)                                           */\n");
-  fprintf(g_FileOut, "/*   - Prints BStrings constructed from any provided non-option arg. */\n");
-  fprintf(g_FileOut, "/*********************************************************************/\n");
-
-  MetaList_VisitEach(&g_NonOptionArgumentStrings, BString_PrintVisitor, g_FileOut);
+  *into                = g_ErrorRing;
+  g_ErrorRing.tail     = g_ErrorRing.head;
+  g_ErrorRing.deferred = 0;
 }
 
-static void RunTests()
+/* Takes over a joined worker's records as if this thread threw them. */
+static void Errors_Adopt(const ErrorRing* from)
 {
-  static const TestFunction s_Tests[] =
+  unsigned tail = from->tail;
+
+  if (from->head - tail > ERROR_RING_CAPACITY)
   {
-    BString_Test
-  };
+    tail = from->head - ERROR_RING_CAPACITY;
+  }
+
+  while (tail != from->head)
+  {
+    ErrorRing_Push(&from->records[tail++ % ERROR_RING_CAPACITY]);
+  }
 
-  size_t count = sizeof(s_Tests) / sizeof(TestFunction);
+  g_ErrorRing.deferred |= from->deferred;
+}
+
+/* Call once workers are joined and their resources released. */
+static void Errors_RaiseDeferred()
+{
+  int deferred = g_ErrorRing.deferred;
+
+  g_DeferFatal         = FALSE;
+  g_ErrorRing.deferred = 0;
 
-  if (optarg)
+  if (deferred & g_FatalMask)
   {
-    int idx = atoi(optarg);
+    Terminate();
+  }
+}
 
-    if (idx >= 0 && idx < count)
+/* A request that read "-" while --serve reads stdin would eat the rest
+ * of the command stream, so refuse it. */
+static bool CheckInputFile(const char* option, const char* filename)
+{
+  if (g_InRequest && g_ServingStdin && !strcmp(filename, "-"))
+  {
+    fprintf(g_FileDefault, "<ERR> --%s cannot read \"-\" while --serve reads stdin.\n",
+            option);
+    Throw(ERR_CODE_BAD_CLI, __FUNCTION__, __LINE__);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static bool SetFatalMask(const char* which)
+{
+  if (!strcmp(which, "fatal"))
+  {
+    g_FatalMask = (int)ERR_CODE_FATAL;
+  }
+  else if (!strcmp(which, "user"))
+  {
+    g_FatalMask = (int)ERR_CODE_FATAL | (int)ERR_CODE_USER_ERROR;
+  }
+  else if (!strcmp(which, "all"))
+  {
+    g_FatalMask = ~0;
+  }
+  else
+  {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void SetOutFile(const char* filename)
+{
+  if (g_FileOut != NULL && g_FileOut != stdout && g_FileOut != g_FileDefault)
+  {
+    fclose(g_FileOut);
+  }
+
+  if (!filename)
+  {
+    g_FileOut = g_FileDefault;
+  }
+  else
+  {
+    g_FileOut = fopen(filename, "w");
+
+    if (!g_FileOut)
+    {
+      Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    }
+  }
+}
+
+/*********************************************************************/
+/* PRIVATE */              /* FUNCTIONS */                   /* DUMP */
+/*********************************************************************/
+
+/* Packed dumps store the source bytes (the text is a pure function of
+   them, at 1/8 the size) run-length coded, in frames:
+
+     header  "BEPS" | version:u8 | bytes_per_line:u8
+     frame   raw_len:u32le | packed_len:u32le | packed_len payload bytes
+
+   Payload control bytes: 0x00..0x7F = (c + 1) literal bytes follow;
+   0x80..0xFF = the next byte repeats ((c & 0x7F) + PACK_MIN_RUN) times. */
+
+#define DUMP_BLOCK_BYTES      65536
+#define DUMP_BYTES_PER_LINE   4 /* one CString_FillFromInt32 layout */
+
+#define PACK_MAGIC            "BEPS"
+#define PACK_VERSION          1
+#define PACK_HEADER_BYTES     6
+#define PACK_FRAME_BYTES      8
+#define PACK_MAX_LITERAL      128
+#define PACK_MIN_RUN          3
+#define PACK_MAX_RUN          (PACK_MIN_RUN + 127)
+#define PACK_BOUND(len)       ((len) + (len) / PACK_MAX_LITERAL + 1)
+
+static size_t Pack_FlushLiterals(const unsigned char* in, size_t count,
+                                 unsigned char* out)
+{
+  if (count)
+  {
+    out[0] = (unsigned char)(count - 1);
+    memcpy(out + 1, in, count);
+    return count + 1;
+  }
+
+  return 0;
+}
+
+/* out must hold PACK_BOUND(len) bytes. */
+static size_t Pack_Encode(const unsigned char* in, size_t len,
+                          unsigned char* out)
+{
+  size_t read      = 0;
+  size_t write     = 0;
+  size_t lit_start = 0;
+
+  while (read < len)
+  {
+    size_t run = 1;
+
+    while (read + run < len && run < PACK_MAX_RUN && in[read + run] == in[read])
+    {
+      ++run;
+    }
+
+    if (run >= PACK_MIN_RUN)
+    {
+      write += Pack_FlushLiterals(in + lit_start, read - lit_start, out + write);
+      out[write++] = (unsigned char)(0x80 | (run - PACK_MIN_RUN));
+      out[write++] = in[read];
+      read        += run;
+      lit_start    = read;
+    }
+    else if (++read - lit_start == PACK_MAX_LITERAL)
+    {
+      write += Pack_FlushLiterals(in + lit_start, read - lit_start, out + write);
+      lit_start = read;
+    }
+  }
+
+  write += Pack_FlushLiterals(in + lit_start, read - lit_start, out + write);
+  return write;
+}
+
+/* Returns the decoded length, or -1 if in is corrupt or overflows out. */
+static long Pack_Decode(const unsigned char* in, size_t len,
+                        unsigned char* out, size_t cap)
+{
+  size_t read  = 0;
+  size_t write = 0;
+
+  while (read < len)
+  {
+    unsigned char control = in[read++];
+
+    if (control & 0x80)
+    {
+      size_t run = (size_t)(control & 0x7F) + PACK_MIN_RUN;
+
+      if (read >= len || write + run > cap)
+      {
+        return -1;
+      }
+
+      memset(out + write, in[read++], run);
+      write += run;
+    }
+    else
+    {
+      size_t count = (size_t)control + 1;
+
+      if (read + count > len || write + count > cap)
+      {
+        return -1;
+      }
+
+      memcpy(out + write, in + read, count);
+      read  += count;
+      write += count;
+    }
+  }
+
+  return (long)write;
+}
+
+static void Pack_PutU32(unsigned char* out, unsigned long value)
+{
+  out[0] = (unsigned char)(value >>  0);
+  out[1] = (unsigned char)(value >>  8);
+  out[2] = (unsigned char)(value >> 16);
+  out[3] = (unsigned char)(value >> 24);
+}
+
+static unsigned long Pack_GetU32(const unsigned char* in)
+{
+  return  (unsigned long)in[0]        | ((unsigned long)in[1] <<  8) |
+         ((unsigned long)in[2] << 16) | ((unsigned long)in[3] << 24);
+}
+
+static void Dump_WriteText(FILE* fout, const unsigned char* bytes, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i + DUMP_BYTES_PER_LINE <= len; i += DUMP_BYTES_PER_LINE)
+  {
+    Sink_WriteBinary32(fout, (unsigned)bytes[i + 0] << 24 |
+                             (unsigned)bytes[i + 1] << 16 |
+                             (unsigned)bytes[i + 2] <<  8 |
+                             (unsigned)bytes[i + 3]);
+    putc('\n', fout);
+  }
+
+  if (i < len)
+  {
+    Sink_WriteBinary8(fout, bytes[i]);
+
+    while (++i < len)
+    {
+      putc(' ', fout);
+      Sink_WriteBinary8(fout, bytes[i]);
+    }
+
+    putc('\n', fout);
+  }
+}
+
+static FILE* Dump_OpenInput(const char* filename)
+{
+  if (!strcmp(filename, "-"))
+  {
+    return stdin;
+  }
+
+  return fopen(filename, "rb");
+}
+
+static void Dump_CloseInput(FILE* fin)
+{
+  if (fin && fin != stdin)
+  {
+    fclose(fin);
+  }
+}
+
+static void Dump(const char* filename, bool packed)
+{
+  unsigned char* raw;
+  unsigned char* pack;
+  size_t         len;
+  FILE*          fin = Dump_OpenInput(filename);
+
+  if (!fin)
+  {
+    Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  raw  = (unsigned char*)calloc(DUMP_BLOCK_BYTES, 1);
+  pack = (unsigned char*)calloc(PACK_BOUND(DUMP_BLOCK_BYTES) + PACK_FRAME_BYTES, 1);
+
+  if (!raw || !pack)
+  {
+    free(raw);
+    free(pack);
+    Dump_CloseInput(fin);
+    Throw(ERR_CODE_BAD_MALLOC, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  if (packed)
+  {
+    unsigned char header[PACK_HEADER_BYTES] =
+    {
+      'B', 'E', 'P', 'S', PACK_VERSION, DUMP_BYTES_PER_LINE
+    };
+
+    fwrite(header, 1, PACK_HEADER_BYTES, g_FileOut);
+  }
+
+  while ((len = fread(raw, 1, DUMP_BLOCK_BYTES, fin)) > 0)
+  {
+    if (packed)
+    {
+      size_t packed_len = Pack_Encode(raw, len, pack + PACK_FRAME_BYTES);
+
+      Pack_PutU32(pack + 0, len);
+      Pack_PutU32(pack + 4, packed_len);
+      fwrite(pack, 1, PACK_FRAME_BYTES + packed_len, g_FileOut);
+    }
+    else
+    {
+      Dump_WriteText(g_FileOut, raw, len);
+    }
+  }
+
+  free(raw);
+  free(pack);
+  Dump_CloseInput(fin);
+}
+
+static void Expand(const char* filename)
+{
+  unsigned char  header[PACK_HEADER_BYTES];
+  unsigned char* raw;
+  unsigned char* pack;
+  bool           corrupt = FALSE;
+  FILE*          fin     = Dump_OpenInput(filename);
+
+  if (!fin)
+  {
+    Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  raw  = (unsigned char*)calloc(DUMP_BLOCK_BYTES, 1);
+  pack = (unsigned char*)calloc(PACK_BOUND(DUMP_BLOCK_BYTES) + PACK_FRAME_BYTES, 1);
+
+  if (!raw || !pack)
+  {
+    free(raw);
+    free(pack);
+    Dump_CloseInput(fin);
+    Throw(ERR_CODE_BAD_MALLOC, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  if (fread(header, 1, PACK_HEADER_BYTES, fin) != PACK_HEADER_BYTES ||
+      memcmp(header, PACK_MAGIC, 4) || header[4] != PACK_VERSION ||
+      header[5] != DUMP_BYTES_PER_LINE)
+  {
+    corrupt = TRUE;
+  }
+
+  while (!corrupt)
+  {
+    unsigned long raw_len;
+    unsigned long packed_len;
+    size_t        got = fread(pack, 1, PACK_FRAME_BYTES, fin);
+
+    if (got == 0)
+    {
+      break;
+    }
+
+    raw_len    = Pack_GetU32(pack + 0);
+    packed_len = Pack_GetU32(pack + 4);
+
+    if (got != PACK_FRAME_BYTES || raw_len > DUMP_BLOCK_BYTES ||
+        packed_len > PACK_BOUND(DUMP_BLOCK_BYTES) ||
+        fread(pack, 1, packed_len, fin) != packed_len ||
+        Pack_Decode(pack, packed_len, raw, raw_len) != (long)raw_len)
+    {
+      corrupt = TRUE;
+      break;
+    }
+
+    Dump_WriteText(g_FileOut, raw, raw_len);
+  }
+
+  free(raw);
+  free(pack);
+  Dump_CloseInput(fin);
+
+  if (corrupt)
+  {
+    Throw(ERR_CODE_BAD_FORMAT, __FUNCTION__, __LINE__);
+  }
+}
+
+
+
+/*********************************************************************/
+/* PRIVATE */              /* FUNCTIONS */                /* MAPPING */
+/*********************************************************************/
+
+#define THREADS_MAX           64
+#define THREADS_MIN_BYTES     (1u << 20)
+
+typedef struct MappedFile
+{
+  const unsigned char* data;
+  size_t               size;
+} MappedFile;
+
+static bool MappedFile_Open(MappedFile* mapped, const char* filename)
+{
+  struct stat info;
+  int         fd = open(filename, O_RDONLY);
+
+  mapped->data = NULL;
+  mapped->size = 0u;
+
+  if (fd < 0)
+  {
+    return FALSE;
+  }
+
+  /* Pipes and devices report a size of 0; mapping them would silently
+     read nothing. */
+  if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode))
+  {
+    close(fd);
+    return FALSE;
+  }
+
+  mapped->size = (size_t)info.st_size;
+
+  if (mapped->size)
+  {
+    void* data = mmap(NULL, mapped->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED)
+    {
+      close(fd);
+      return FALSE;
+    }
+
+    madvise(data, mapped->size, MADV_SEQUENTIAL);
+    mapped->data = (const unsigned char*)data;
+  }
+
+  /* The mapping keeps the file alive on its own. */
+  close(fd);
+  return TRUE;
+}
+
+static void MappedFile_Close(MappedFile* mapped)
+{
+  if (mapped->data)
+  {
+    munmap((void*)mapped->data, mapped->size);
+    mapped->data = NULL;
+  }
+}
+
+/* --threads if given, else one per core, but no thread gets < 1 MiB. */
+static int Threads_Count(size_t bytes)
+{
+  BString* arg   = g_Inputs[OPT_CODE_THREADS].optarg;
+  long     count = arg ? atol(arg->data) : sysconf(_SC_NPROCESSORS_ONLN);
+  size_t   most  = bytes / THREADS_MIN_BYTES;
+
+  if (!arg && (size_t)count > most)
+  {
+    count = (long)most;
+  }
+
+  if (count < 1)
+  {
+    count = 1;
+  }
+
+  return count > THREADS_MAX ? THREADS_MAX : (int)count;
+}
+
+
+
+/*********************************************************************/
+/* PRIVATE */              /* FUNCTIONS */               /* BITSTATS */
+/*********************************************************************/
+
+typedef struct BitStats
+{
+  /* Byte-value counts per byte lane of a word; per-bit counts and the
+     byte histogram are folded out of these at report time. */
+  unsigned long lanes[4][256];
+  unsigned long tail_bytes[256];
+  unsigned long popcounts[33];
+  unsigned long trailing_zeros[33]; /* [0] is zero words, [n + 1] CTZ n */
+  unsigned long words;
+} BitStats;
+
+typedef struct BitStatsJob
+{
+  const unsigned char* data;
+  size_t               len;
+  pthread_t            thread;
+  bool                 started;
+  ErrorRing            errors;
+  BitStats             stats;
+} BitStatsJob;
+
+/* Scalar on purpose: the four histogram scatters per word bound this loop,
+   not the popcount or CTZ, so wider popcount kernels would not help. */
+static void BitStats_Accumulate(BitStats*            stats,
+                                const unsigned char* data,
+                                size_t               len)
+{
+  size_t words = len / 4;
+  size_t i;
+
+  for (i = 0; i < words; ++i)
+  {
+    const unsigned char* bytes = data + i * 4;
+    unsigned             word  = (unsigned)bytes[0]         |
+                                 (unsigned)bytes[1] <<  8   |
+                                 (unsigned)bytes[2] << 16   |
+                                 (unsigned)bytes[3] << 24;
+
+    ++stats->lanes[0][bytes[0]];
+    ++stats->lanes[1][bytes[1]];
+    ++stats->lanes[2][bytes[2]];
+    ++stats->lanes[3][bytes[3]];
+    ++stats->popcounts[POPCNT(word)];
+    ++stats->trailing_zeros[CTZ((int)word) + 1];
+  }
+
+  for (i = words * 4; i < len; ++i)
+  {
+    ++stats->tail_bytes[data[i]];
+  }
+
+  stats->words += words;
+}
+
+static void BitStats_Merge(BitStats* into, const BitStats* from)
+{
+  int i;
+  int j;
+
+  for (i = 0; i < 4; ++i)
+  {
+    for (j = 0; j < 256; ++j)
+    {
+      into->lanes[i][j] += from->lanes[i][j];
+    }
+  }
+
+  for (j = 0; j < 256; ++j)
+  {
+    into->tail_bytes[j] += from->tail_bytes[j];
+  }
+
+  for (j = 0; j < 33; ++j)
+  {
+    into->popcounts[j]      += from->popcounts[j];
+    into->trailing_zeros[j] += from->trailing_zeros[j];
+  }
+
+  into->words += from->words;
+}
+
+static unsigned long BitStats_BitCount(const BitStats* stats, int bit)
+{
+  unsigned long count = 0;
+  int           j;
+
+  for (j = 0; j < 256; ++j)
+  {
+    if (j & (1 << (bit % 8)))
+    {
+      count += stats->lanes[bit / 8][j];
+    }
+  }
+
+  return count;
+}
+
+static unsigned long BitStats_ByteCount(const BitStats* stats, int value)
+{
+  return stats->tail_bytes[value] + stats->lanes[0][value] +
+         stats->lanes[1][value] + stats->lanes[2][value] +
+         stats->lanes[3][value];
+}
+
+/* Where share i of count ends: on a word boundary, except that the last
+   share runs to the end and so also takes the tail bytes. */
+static size_t BitStats_ShareEnd(size_t size, int count, int i)
+{
+  if (i == count - 1)
+  {
+    return size;
+  }
+
+  return (size / count * (i + 1)) & ~(size_t)3u;
+}
+
+static void BitStats_Worker(BitStatsJob* job)
+{
+  BitStats_Accumulate(&job->stats, job->data, job->len);
+}
+
+static void* BitStats_Thread(void* v_job)
+{
+  BitStatsJob* job = (BitStatsJob*)v_job;
+
+  g_DeferFatal = TRUE;
+  BitStats_Worker(job);
+  Errors_Detach(&job->errors);
+  return NULL;
+}
+
+static void BitStats_Report(FILE*           fout,
+                            const char*     filename,
+                            const BitStats* stats,
+                            size_t          bytes,
+                            int             threads)
+{
+  int i;
+  int j;
+
+  fprintf(fout, "/* bitstats: \"%s\" */\n", filename);
+  fprintf(fout, "bytes    %lu\n", (unsigned long)bytes);
+  fprintf(fout, "words    %lu (32-bit little-endian; %lu tail bytes only "
+                "counted as byte values)\n",
+                stats->words, (unsigned long)(bytes - stats->words * 4));
+  fprintf(fout, "threads  %d\n", threads);
+
+  fprintf(fout, "\n/* set count per bit position */\n");
+
+  for (i = 0; i < 32; ++i)
+  {
+    fprintf(fout, "bit %.2d   %lu\n", i, BitStats_BitCount(stats, i));
+  }
+
+  fprintf(fout, "\n/* words per popcount */\n");
+
+  for (i = 0; i <= 32; ++i)
+  {
+    fprintf(fout, "pop %.2d   %lu\n", i, stats->popcounts[i]);
+  }
+
+  fprintf(fout, "\n/* words per trailing zero count */\n");
+  fprintf(fout, "zero     %lu\n", stats->trailing_zeros[0]);
+
+  for (i = 0; i < 32; ++i)
+  {
+    fprintf(fout, "ctz %.2d   %lu\n", i, stats->trailing_zeros[i + 1]);
+  }
+
+  fprintf(fout, "\n/* bytes per value (nonzero counts only) */\n");
+
+  for (j = 0; j < 256; ++j)
+  {
+    unsigned long count = BitStats_ByteCount(stats, j);
+
+    if (count)
+    {
+      fprintf(fout, "0x%.2X ", j);
+      Sink_WriteBinary8(fout, (unsigned char)j);
+      fputs("  ", fout);
+      Sink_WriteUInt(fout, count);
+      putc('\n', fout);
+    }
+  }
+}
+
+static void ReportBitStats(const char* filename)
+{
+  MappedFile   mapped;
+  BitStatsJob* jobs;
+  int          count;
+  int          i;
+  size_t       start = 0;
+
+  if (!MappedFile_Open(&mapped, filename))
+  {
+    Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  count = Threads_Count(mapped.size);
+  jobs  = (BitStatsJob*)calloc(count, sizeof(BitStatsJob));
+
+  if (!jobs)
+  {
+    MappedFile_Close(&mapped);
+    Throw(ERR_CODE_BAD_MALLOC, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  g_DeferFatal = TRUE;
+
+  for (i = 0; i < count; ++i)
+  {
+    size_t end = BitStats_ShareEnd(mapped.size, count, i);
+
+    jobs[i].data = mapped.data + start;
+    jobs[i].len  = end - start;
+    start        = end;
+
+    if (i > 0)
+    {
+      jobs[i].started = !pthread_create(&jobs[i].thread, NULL,
+                                        BitStats_Thread, &jobs[i]);
+    }
+  }
+
+  /* This thread takes the first share, and any that failed to start. */
+  BitStats_Worker(&jobs[0]);
+
+  for (i = 1; i < count; ++i)
+  {
+    if (jobs[i].started)
+    {
+      pthread_join(jobs[i].thread, NULL);
+      Errors_Adopt(&jobs[i].errors);
+    }
+    else
+    {
+      BitStats_Worker(&jobs[i]);
+    }
+
+    BitStats_Merge(&jobs[0].stats, &jobs[i].stats);
+  }
+
+  BitStats_Report(g_FileOut, filename, &jobs[0].stats, mapped.size, count);
+
+  free(jobs);
+  MappedFile_Close(&mapped);
+  Errors_RaiseDeferred();
+}
+
+
+
+/*********************************************************************/
+/* PRIVATE */              /* FUNCTIONS */                /* BITDIFF */
+/*********************************************************************/
+
+#define BITDIFF_BLOCK_BYTES 4096
+#define BITDIFF_CHUNK_DIFFS 4096
+
+typedef struct BitDiffEntry
+{
+  size_t        offset;
+  unsigned char a;
+  unsigned char b;
+} BitDiffEntry;
+
+/* Formatting state; only the thread that called ReportBitDiff uses it. */
+typedef struct BitDiffReport
+{
+  FILE*         fout;
+  BString*      text;
+  unsigned long bytes;
+  unsigned long bits;
+} BitDiffReport;
+
+/* A worker fills chunks[filling] while the reporter formats the other
+   one, so each job holds at most two chunks no matter how much differs. */
+typedef struct BitDiffJob
+{
+  const unsigned char* a;
+  const unsigned char* b;
+  size_t               start;
+  size_t               end;
+  BitDiffEntry*        chunks[2];
+  size_t               counts[2];
+  int                  filling;
+  bool                 ready;
+  bool                 done;
+  BitDiffReport*       inline_report;
+  pthread_mutex_t      lock;
+  pthread_cond_t       changed;
+  pthread_t            thread;
+  bool                 started;
+  ErrorRing            errors;
+} BitDiffJob;
+
+static void BitDiff_Format(BitDiffReport*      report,
+                           const BitDiffEntry* entries,
+                           size_t              count)
+{
+  BString* text = report->text;
+  size_t   i;
+
+  BString_Clear(text);
+
+  for (i = 0; i < count; ++i)
+  {
+    unsigned char delta = entries[i].a ^ entries[i].b;
+
+    BString_PushBackCString(text, "offset ");
+    BString_AppendUInt(text, (unsigned long)entries[i].offset);
+    BString_PushBackCString(text, "  a ");
+    BString_AppendBinary8(text, entries[i].a);
+    BString_PushBackCString(text, "  b ");
+    BString_AppendBinary8(text, entries[i].b);
+    BString_PushBackCString(text, "  xor ");
+    BString_AppendBinary8(text, delta);
+    BString_Append(text, "\n", 1);
+
+    ++report->bytes;
+    report->bits += POPCNT(delta);
+  }
+
+  fwrite(text->data, 1, text->size, report->fout);
+}
+
+/* Worker side: publishes the full chunk and switches to the other one,
+   waiting first if the reporter has not finished with it. */
+static void BitDiff_Handoff(BitDiffJob* job)
+{
+  if (job->inline_report)
+  {
+    BitDiff_Format(job->inline_report, job->chunks[job->filling],
+                   job->counts[job->filling]);
+    job->counts[job->filling] = 0u;
+    return;
+  }
+
+  pthread_mutex_lock(&job->lock);
+
+  while (job->ready)
+  {
+    pthread_cond_wait(&job->changed, &job->lock);
+  }
+
+  job->ready                = TRUE;
+  job->filling             ^= 1;
+  job->counts[job->filling] = 0u;
+
+  pthread_cond_signal(&job->changed);
+  pthread_mutex_unlock(&job->lock);
+}
+
+static void BitDiff_Bytes(BitDiffJob* job, size_t from, size_t to)
+{
+  size_t i;
+
+  for (i = from; i < to; ++i)
+  {
+    if (job->a[i] != job->b[i])
+    {
+      BitDiffEntry* entry = &job->chunks[job->filling][job->counts[job->filling]++];
+
+      entry->offset = i;
+      entry->a      = job->a[i];
+      entry->b      = job->b[i];
+
+      if (job->counts[job->filling] == BITDIFF_CHUNK_DIFFS)
+      {
+        BitDiff_Handoff(job);
+      }
+    }
+  }
+}
+
+static void BitDiff_Worker(BitDiffJob* job)
+{
+  size_t pos;
+
+  for (pos = job->start; pos < job->end; pos += BITDIFF_BLOCK_BYTES)
+  {
+    size_t end = pos + BITDIFF_BLOCK_BYTES < job->end ? pos + BITDIFF_BLOCK_BYTES
+                                                      : job->end;
+    size_t i;
+
+    /* libc's vectorized memcmp skips identical blocks at full bandwidth. */
+    if (!memcmp(job->a + pos, job->b + pos, end - pos))
+    {
+      continue;
+    }
+
+    for (i = pos; i + 8 <= end; i += 8)
+    {
+      unsigned long long word_a;
+      unsigned long long word_b;
+
+      memcpy(&word_a, job->a + i, 8);
+      memcpy(&word_b, job->b + i, 8);
+
+      if (word_a != word_b)
+      {
+        BitDiff_Bytes(job, i, i + 8);
+      }
+    }
+
+    BitDiff_Bytes(job, i, end);
+  }
+
+  if (job->counts[job->filling])
+  {
+    BitDiff_Handoff(job);
+  }
+
+  if (!job->inline_report)
+  {
+    pthread_mutex_lock(&job->lock);
+    job->done = TRUE;
+    pthread_cond_signal(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+  }
+}
+
+static void* BitDiff_Thread(void* v_job)
+{
+  BitDiffJob* job = (BitDiffJob*)v_job;
+
+  g_DeferFatal = TRUE;
+  BitDiff_Worker(job);
+  Errors_Detach(&job->errors);
+  return NULL;
+}
+
+/* Reporter side: formats a threaded job's chunks as they are published. */
+static void BitDiff_Drain(BitDiffJob* job, BitDiffReport* report)
+{
+  while (TRUE)
+  {
+    int published;
+
+    pthread_mutex_lock(&job->lock);
+
+    while (!job->ready && !job->done)
+    {
+      pthread_cond_wait(&job->changed, &job->lock);
+    }
+
+    if (!job->ready)
+    {
+      pthread_mutex_unlock(&job->lock);
+      break;
+    }
+
+    published = !job->filling;
+    pthread_mutex_unlock(&job->lock);
+
+    BitDiff_Format(report, job->chunks[published], job->counts[published]);
+
+    pthread_mutex_lock(&job->lock);
+    job->ready = FALSE;
+    pthread_cond_signal(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+  }
+}
+
+static void ReportBitDiff(const char* filename_a, const char* filename_b)
+{
+  MappedFile    mapped_a;
+  MappedFile    mapped_b;
+  BitDiffJob*   jobs;
+  BitDiffEntry* entries;
+  BitDiffReport report;
+  size_t        len;
+  int           count;
+  int           i;
+
+  if (!MappedFile_Open(&mapped_a, filename_a))
+  {
+    Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  if (!MappedFile_Open(&mapped_b, filename_b))
+  {
+    MappedFile_Close(&mapped_a);
+    Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  len     = mapped_a.size < mapped_b.size ? mapped_a.size : mapped_b.size;
+  count   = Threads_Count(len);
+  jobs    = (BitDiffJob*)calloc(count, sizeof(BitDiffJob));
+  entries = (BitDiffEntry*)calloc(2 * BITDIFF_CHUNK_DIFFS * count,
+                                  sizeof(BitDiffEntry));
+
+  report.fout  = g_FileOut;
+  report.text  = BString_Create(NULL, 0);
+  report.bytes = 0ul;
+  report.bits  = 0ul;
+
+  if (!jobs || !entries || !report.text)
+  {
+    free(jobs);
+    free(entries);
+    BString_Dispose((void**)&report.text);
+    MappedFile_Close(&mapped_a);
+    MappedFile_Close(&mapped_b);
+    Throw(ERR_CODE_BAD_MALLOC, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  fprintf(g_FileOut, "/* bitdiff: \"%s\" vs \"%s\" */\n", filename_a, filename_b);
+
+  g_DeferFatal = TRUE;
+
+  /* Workers never allocate: every buffer they touch is made here. */
+  for (i = 0; i < count; ++i)
+  {
+    jobs[i].a         = mapped_a.data;
+    jobs[i].b         = mapped_b.data;
+    jobs[i].start     = (i == 0) ? 0u : jobs[i - 1].end;
+    jobs[i].end       = (i == count - 1) ? len : len / count * (i + 1);
+    jobs[i].chunks[0] = entries + (2 * i + 0) * BITDIFF_CHUNK_DIFFS;
+    jobs[i].chunks[1] = entries + (2 * i + 1) * BITDIFF_CHUNK_DIFFS;
+
+    pthread_mutex_init(&jobs[i].lock, NULL);
+    pthread_cond_init(&jobs[i].changed, NULL);
+
+    if (i > 0)
+    {
+      jobs[i].started = !pthread_create(&jobs[i].thread, NULL,
+                                        BitDiff_Thread, &jobs[i]);
+    }
+  }
+
+  /* Jobs report in offset order. This thread runs the first share, and
+     any that failed to start, formatting straight into the report. */
+  for (i = 0; i < count; ++i)
+  {
+    if (jobs[i].started)
+    {
+      BitDiff_Drain(&jobs[i], &report);
+      pthread_join(jobs[i].thread, NULL);
+      Errors_Adopt(&jobs[i].errors);
+    }
+    else
+    {
+      jobs[i].inline_report = &report;
+      BitDiff_Worker(&jobs[i]);
+    }
+
+    pthread_mutex_destroy(&jobs[i].lock);
+    pthread_cond_destroy(&jobs[i].changed);
+  }
+
+  fprintf(g_FileOut, "/* %lu differing bytes, %lu differing bits in %lu "
+                     "compared bytes */\n",
+                     report.bytes, report.bits, (unsigned long)len);
+
+  if (mapped_a.size != mapped_b.size)
+  {
+    fprintf(g_FileOut, "/* sizes differ: a is %lu bytes, b is %lu bytes */\n",
+            (unsigned long)mapped_a.size, (unsigned long)mapped_b.size);
+  }
+
+  free(jobs);
+  free(entries);
+  BString_Dispose((void**)&report.text);
+  MappedFile_Close(&mapped_a);
+  MappedFile_Close(&mapped_b);
+  Errors_RaiseDeferred();
+}
+
+
+
+/*********************************************************************/
+/* PRIVATE */              /* FUNCTIONS */                /* RECORDS */
+/*********************************************************************/
+
+#define RECORDS_BLOCK_BYTES (1u << 20)
+
+/* Records are chained privately and handed to MetaList_PushBack as one
+   addition, since every push walks (and recounts) the whole list. */
+typedef struct RecordBatch
+{
+  MetaObjectPtr head;
+  MetaObjectPtr tail;
+  size_t        count;
+  size_t        window;
+  MetaList*     list;
+  FILE*         fout; /* where a windowed flush prints its records */
+} RecordBatch;
+
+static void RecordBatch_Flush(RecordBatch* batch)
+{
+  MetaObjectPtr node      = batch->head;
+  size_t        remaining = batch->count;
+
+  if (!batch->count)
+  {
+    return;
+  }
+
+  while (node)
+  {
+    node->nextcount = --remaining;
+    node            = node->next;
+  }
+
+  MetaList_PushBack(batch->list, batch->head);
+  batch->head  = NULL;
+  batch->tail  = NULL;
+  batch->count = 0u;
+
+  if (batch->window)
+  {
+    MetaList_VisitEach(batch->list, BString_PrintVisitor, batch->fout);
+    MetaList_Clear(batch->list);
+  }
+}
+
+static void RecordBatch_Add(RecordBatch* batch, const char* str, size_t len)
+{
+  BString* record;
+
+  /* Empty records are skipped, like empty non-option arguments. */
+  if (!len)
+  {
+    return;
+  }
+
+  record = BString_Create(str, len);
+
+  if (record)
+  {
+    if (batch->tail)
+    {
+      batch->tail->next = &record->metadata;
+    }
+    else
+    {
+      batch->head = &record->metadata;
+    }
+
+    batch->tail = &record->metadata;
+
+    if (++batch->count == batch->window)
+    {
+      RecordBatch_Flush(batch);
+    }
+  }
+}
+
+static void RecordBatch_Construct(RecordBatch* batch,
+                                  MetaList*    list,
+                                  size_t       window,
+                                  FILE*        fout)
+{
+  batch->head   = NULL;
+  batch->tail   = NULL;
+  batch->count  = 0u;
+  batch->window = window;
+  batch->list   = list;
+  batch->fout   = fout;
+}
+
+/* Adds every delimited record of fin to the batch, then flushes it. */
+static void RecordBatch_Read(RecordBatch* batch, FILE* fin, char delimiter)
+{
+  BString* pending;
+  char*    block;
+  size_t   len;
+
+  block   = (char*)malloc(RECORDS_BLOCK_BYTES);
+  pending = BString_Create(NULL, 0);
+
+  if (!block || !pending)
+  {
+    free(block);
+    BString_Dispose((void**)&pending);
+    Throw(ERR_CODE_BAD_MALLOC, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  while ((len = fread(block, 1, RECORDS_BLOCK_BYTES, fin)) > 0)
+  {
+    const char* pos = block;
+    const char* end = block + len;
+    const char* hit;
+
+    /* memchr is libc's vectorized delimiter scan. */
+    while ((hit = (const char*)memchr(pos, delimiter, end - pos)) != NULL)
+    {
+      if (pending->size)
+      {
+        BString_Append(pending, pos, hit - pos);
+        RecordBatch_Add(batch, pending->data, pending->size);
+        BString_Clear(pending);
+      }
+      else
+      {
+        RecordBatch_Add(batch, pos, hit - pos);
+      }
+
+      pos = hit + 1;
+    }
+
+    /* A record split across blocks waits here for its delimiter. */
+    BString_Append(pending, pos, end - pos);
+  }
+
+  RecordBatch_Add(batch, pending->data, pending->size);
+  RecordBatch_Flush(batch);
+
+  free(block);
+  BString_Dispose((void**)&pending);
+}
+
+static void ReadRecords(const char* filename, char delimiter, size_t window)
+{
+  RecordBatch batch;
+  MetaList    window_list;
+  FILE*       fin = Dump_OpenInput(filename);
+
+  if (!fin)
+  {
+    Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    return;
+  }
+
+  MetaList_Construct(&window_list);
+  RecordBatch_Construct(&batch,
+                        window ? &window_list : &g_NonOptionArgumentStrings,
+                        window, g_FileOut);
+  RecordBatch_Read(&batch, fin, delimiter);
+  Dump_CloseInput(fin);
+}
+
+
+
+/*********************************************************************/
+/* PRIVATE */              /* FUNCTIONS */                  /* TESTS */
+/*********************************************************************/
+
+#define TEST_CHECK(condition)                                          \
+        Test_Check((condition), #condition, __FUNCTION__, __LINE__)
+
+static bool Test_Check(bool        passed,
+                       const char* condition,
+                       const char* func,
+                       unsigned    lineno)
+{
+  fprintf(g_FileOut, "%s  %s\n", passed ? "pass" : "FAIL", condition);
+
+  if (!passed)
+  {
+    Throw(ERR_CODE_TEST_FAILED, func, lineno);
+  }
+
+  return passed;
+}
+
+static void BString_Test()
+{
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+  fprintf(g_FileOut, "/* BString_Test (--test=0)                                           */\n");
+  fprintf(g_FileOut, "/*   - Prints BStrings constructed from any provided non-option arg. */\n");
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+
+  MetaList_VisitEach(&g_NonOptionArgumentStrings, BString_PrintVisitor, g_FileOut);
+}
+
+static void Format_Test()
+{
+  char     buffer[CSTRING_UINT_LENGTH + 1];
+  char*    allocated;
+  BString* bstring;
+
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+  fprintf(g_FileOut, "/* Format_Test (--test=1)                                            */\n");
+  fprintf(g_FileOut, "/*   - Checks the fillers and the BString append formatters.         */\n");
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+
+  /* Fillers: bit order, group spacing, and both ends of the UInt range. */
+  TEST_CHECK(CString_FillFromByte(buffer, 0xA5) == 8 && !strcmp(buffer, "10100101"));
+  TEST_CHECK(CString_FillFromUInt(buffer, 0) == 1 && !strcmp(buffer, "0"));
+  TEST_CHECK(CString_FillFromUInt(buffer, 18446744073709551615ul) == 20 &&
+             !strcmp(buffer, "18446744073709551615"));
+
+  /* The allocating helpers are wrappers and must agree with the fillers. */
+  allocated = CString_NewFromInt32(0x80000001u);
+  TEST_CHECK(allocated && !strcmp(allocated, "10000000 00000000 00000000 00000001"));
+  free(allocated);
+  allocated = CString_NewFromByte(0x80);
+  TEST_CHECK(allocated && !strcmp(allocated, "10000000"));
+  free(allocated);
+
+  /* Appending to a constructed (not empty) string: size must not count
+     the terminator, or the append lands past it. */
+  bstring = BString_Create("ab", 2);
+  BString_PushBackChar(bstring, 'c');
+  BString_AppendBinary8(bstring, 0x0F);
+  TEST_CHECK(bstring->size == 11 && !strcmp(bstring->data, "abc00001111"));
+
+  /* Each append grows capacity on its own and keeps size == strlen. */
+  BString_Clear(bstring);
+  BString_AppendQuoted(bstring, "q", 1);
+  BString_AppendUInt(bstring, 42);
+  BString_AppendBinary32(bstring, 0x01020304u);
+  TEST_CHECK(!strcmp(bstring->data,
+                     "\"q\"4200000001 00000010 00000011 00000100"));
+  TEST_CHECK(bstring->size == strlen(bstring->data) &&
+             bstring->size < bstring->capacity);
+
+  BString_Dispose((void**)&bstring);
+}
+
+static size_t MetaPool_CountSlabs(const MetaPool* pool)
+{
+  size_t          count = 0;
+  const MetaSlab* slab  = pool->slabs;
+
+  for (; slab; slab = slab->next)
+  {
+    ++count;
+  }
+
+  return count;
+}
+
+static void MetaPool_Test()
+{
+  static MetaObjectPtr s_Objects[128];
+
+  /* OptionInputs are never pooled elsewhere, so this pool is ours. */
+  METAOBJECT_TYPE type     = METAOBJECT_TYPE_OPTION_INPUT;
+  MetaPool*       pool     = &g_MetaPools[(int)type];
+  size_t          per_slab = (METAPOOL_SLAB_BYTES - METAPOOL_CACHE_LINE) /
+                             MetaPool_Stride(type);
+  size_t          i;
+  bool            aligned  = TRUE;
+  bool            distinct = TRUE;
+  MetaObjectPtr   first;
+
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+  fprintf(g_FileOut, "/* MetaPool_Test (--test=2)                                          */\n");
+  fprintf(g_FileOut, "/*   - Checks slab growth, alignment and free-list reuse.            */\n");
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+
+  MetaPool_Release(pool);
+
+  if (!TEST_CHECK(per_slab + 1 <= sizeof(s_Objects) / sizeof(MetaObjectPtr)))
+  {
+    return;
+  }
+
+  /* Fresh objects come back zeroed, already tagged with their type. */
+  first = (MetaObjectPtr)MetaObject_Alloc(type);
+  TEST_CHECK(first && first->type == type && !first->next && !first->dtor);
+  TEST_CHECK(((size_t)pool->slabs % METAPOOL_CACHE_LINE) == 0);
+
+  /* The free list is LIFO: a dispose/create cycle reuses the same slot. */
+  MetaObject_Free(first);
+  TEST_CHECK(MetaObject_Alloc(type) == (void*)first);
+  MetaObject_Free(first);
+
+  /* One more object than a slab holds forces exactly one more slab. */
+  for (i = 0; i < per_slab + 1; ++i)
+  {
+    s_Objects[i] = (MetaObjectPtr)MetaObject_Alloc(type);
+    aligned     &= ((size_t)s_Objects[i] % 16) == 0;
+    distinct    &= i == 0 || s_Objects[i] != s_Objects[i - 1];
+  }
+
+  TEST_CHECK(aligned && distinct);
+  TEST_CHECK(MetaPool_CountSlabs(pool) == 2);
+
+  /* Returning and re-taking them all must not grow the pool again. */
+  for (i = 0; i < per_slab + 1; ++i)
+  {
+    MetaObject_Free(s_Objects[i]);
+  }
+
+  for (i = 0; i < per_slab + 1; ++i)
+  {
+    s_Objects[i] = (MetaObjectPtr)MetaObject_Alloc(type);
+  }
+
+  TEST_CHECK(MetaPool_CountSlabs(pool) == 2);
+
+  MetaPool_Release(pool);
+}
+
+#define PACK_TEST_BYTES 512
+
+/* Encodes to exactly packed_len bytes and decodes back to the input. */
+static bool Pack_RoundTrips(const unsigned char* in, size_t len, size_t packed_len)
+{
+  static unsigned char s_Packed[PACK_BOUND(PACK_TEST_BYTES)];
+  static unsigned char s_Unpacked[PACK_TEST_BYTES];
+
+  size_t got = Pack_Encode(in, len, s_Packed);
+
+  return got == packed_len &&
+         Pack_Decode(s_Packed, got, s_Unpacked, PACK_TEST_BYTES) == (long)len &&
+         !memcmp(in, s_Unpacked, len);
+}
+
+static void Pack_Test()
+{
+  static const unsigned char s_Mixed[]   = "abxxxxxc";
+  static const unsigned char s_Overrun[] = { 0x80 | 5, 'z' };
+
+  unsigned char distinct[PACK_TEST_BYTES];
+  unsigned char same[PACK_TEST_BYTES];
+  unsigned char packed[PACK_BOUND(PACK_TEST_BYTES)];
+  unsigned char unpacked[PACK_TEST_BYTES];
+  size_t        packed_len;
+  size_t        i;
+
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+  fprintf(g_FileOut, "/* Pack_Test (--test=3)                                              */\n");
+  fprintf(g_FileOut, "/*   - Round-trips the packed dump coder at its run/literal limits.  */\n");
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+
+  for (i = 0; i < PACK_TEST_BYTES; ++i)
+  {
+    distinct[i] = (unsigned char)i;
+    same[i]     = 0x5A;
+  }
+
+  /* Nothing in, nothing out. */
+  TEST_CHECK(Pack_RoundTrips(distinct, 0, 0));
+
+  /* Literals: exactly PACK_MAX_LITERAL fit one control byte; one more
+     starts a second literal chunk. */
+  TEST_CHECK(Pack_RoundTrips(distinct, PACK_MAX_LITERAL, PACK_MAX_LITERAL + 1));
+  TEST_CHECK(Pack_RoundTrips(distinct, PACK_MAX_LITERAL + 1, PACK_MAX_LITERAL + 3));
+
+  /* Runs: PACK_MIN_RUN is the shortest coded run, shorter stays literal. */
+  TEST_CHECK(Pack_RoundTrips(same, PACK_MIN_RUN, 2));
+  TEST_CHECK(Pack_RoundTrips(same, PACK_MIN_RUN - 1, PACK_MIN_RUN));
+
+  /* Runs: PACK_MAX_RUN fits one pair; one more spills into a literal. */
+  TEST_CHECK(Pack_RoundTrips(same, PACK_MAX_RUN, 2));
+  TEST_CHECK(Pack_RoundTrips(same, PACK_MAX_RUN + 1, 4));
+
+  /* Literals flushed around a run: "ab" | 5 x 'x' | "c". */
+  TEST_CHECK(Pack_RoundTrips(s_Mixed, sizeof(s_Mixed) - 1, 3 + 2 + 2));
+
+  /* Truncated frame: a literal chunk missing its last byte. */
+  packed_len = Pack_Encode(distinct, PACK_MAX_LITERAL, packed);
+  TEST_CHECK(Pack_Decode(packed, packed_len - 1, unpacked, PACK_TEST_BYTES) == -1);
+
+  /* Truncated frame: a run control byte with no value byte after it. */
+  TEST_CHECK(Pack_Decode(s_Overrun, 1, unpacked, PACK_TEST_BYTES) == -1);
+
+  /* Corrupt frame: decoding more than raw_len promised must fail. */
+  TEST_CHECK(Pack_Decode(s_Overrun, 2, unpacked, PACK_MIN_RUN + 4) == -1);
+  TEST_CHECK(Pack_Decode(s_Overrun, 2, unpacked, PACK_MIN_RUN + 5) == PACK_MIN_RUN + 5);
+}
+
+/* Five words covering zero, lowest, highest and full bits, plus three
+   tail bytes that only count as byte values. */
+static const unsigned char s_BitStatsSample[] =
+{
+  0x00, 0x00, 0x00, 0x00,
+  0x01, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x80,
+  0xFF, 0xFF, 0xFF, 0xFF,
+  0x00, 0x0F, 0x00, 0x00,
+  0x01, 0x80, 0xFF
+};
+
+/* Checks stats against the hand-computed counts of s_BitStatsSample. */
+static bool BitStats_MatchesSample(const BitStats* stats)
+{
+  bool matches = stats->words == 5;
+  int  i;
+
+  for (i = 0; i < 32; ++i)
+  {
+    bool twice = i == 0 || (i >= 8 && i < 12) || i == 31;
+
+    matches &= BitStats_BitCount(stats, i) == (twice ? 2u : 1u);
+  }
+
+  for (i = 0; i <= 32; ++i)
+  {
+    unsigned long pop = (i == 1) ? 2 : (i == 0 || i == 4 || i == 32);
+    unsigned long ctz = (i == 1) ? 2 : (i == 0 || i == 9 || i == 32);
+
+    matches &= stats->popcounts[i] == pop;
+    matches &= stats->trailing_zeros[i] == ctz;
+  }
+
+  for (i = 0; i < 256; ++i)
+  {
+    unsigned long bytes = (i == 0x00) ? 13 : (i == 0xFF) ? 5 :
+                          (i == 0x01 || i == 0x80) ? 2 : (i == 0x0F);
+
+    matches &= BitStats_ByteCount(stats, i) == bytes;
+  }
+
+  return matches;
+}
+
+static void BitStats_Test()
+{
+  static BitStats s_Whole;
+  static BitStats s_Shares[3];
+  static BitStats s_Uneven[2];
+
+  size_t len   = sizeof(s_BitStatsSample);
+  size_t start = 0;
+  int    i;
+
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+  fprintf(g_FileOut, "/* BitStats_Test (--test=4)                                          */\n");
+  fprintf(g_FileOut, "/*   - Checks accumulated, split and merged --bitstats counts.       */\n");
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+
+  memset(&s_Whole, 0, sizeof(s_Whole));
+  memset(s_Shares, 0, sizeof(s_Shares));
+  memset(s_Uneven, 0, sizeof(s_Uneven));
+
+  BitStats_Accumulate(&s_Whole, s_BitStatsSample, len);
+  TEST_CHECK(BitStats_MatchesSample(&s_Whole));
+
+  /* 23 bytes in three shares end at 4 and 12; the last takes the tail. */
+  TEST_CHECK(BitStats_ShareEnd(len, 3, 0) == 4);
+  TEST_CHECK(BitStats_ShareEnd(len, 3, 1) == 12);
+  TEST_CHECK(BitStats_ShareEnd(len, 3, 2) == len);
+
+  for (i = 0; i < 3; ++i)
+  {
+    size_t end = BitStats_ShareEnd(len, 3, i);
+
+    BitStats_Accumulate(&s_Shares[i], s_BitStatsSample + start, end - start);
+    start = end;
+  }
+
+  BitStats_Merge(&s_Shares[0], &s_Shares[1]);
+  BitStats_Merge(&s_Shares[0], &s_Shares[2]);
+  TEST_CHECK(BitStats_MatchesSample(&s_Shares[0]));
+
+  /* A 16-byte share and a 7-byte share of one word plus the tail. */
+  BitStats_Accumulate(&s_Uneven[0], s_BitStatsSample, 16);
+  BitStats_Accumulate(&s_Uneven[1], s_BitStatsSample + 16, len - 16);
+  TEST_CHECK(s_Uneven[1].words == 1 && s_Uneven[1].tail_bytes[0xFF] == 1);
+
+  BitStats_Merge(&s_Uneven[1], &s_Uneven[0]);
+  TEST_CHECK(BitStats_MatchesSample(&s_Uneven[1]));
+}
+
+/* "x", an empty record, one record straddling the first block boundary
+   and a last record with no delimiter. */
+static FILE* Records_WriteSample(char delimiter)
+{
+  FILE*  file = tmpfile();
+  size_t i;
+
+  if (file)
+  {
+    fputc('x', file);
+    fputc(delimiter, file);
+    fputc(delimiter, file);
+
+    for (i = 0; i < RECORDS_BLOCK_BYTES; ++i)
+    {
+      fputc('b', file);
+    }
+
+    fputc(delimiter, file);
+    fputs("tail", file);
+    rewind(file);
+  }
+
+  return file;
+}
+
+/* The empty record is skipped; the rest arrive whole and correctly counted. */
+static bool Records_MatchSample(const MetaList* list)
+{
+  static const size_t s_Sizes[] = { 1, RECORDS_BLOCK_BYTES, 4 };
+
+  MetaObjectPtr node    = list->head;
+  bool          matches = list->size == 3;
+  size_t        i;
+
+  for (i = 0; i < 3 && matches; ++i)
+  {
+    const BString* record = (const BString*)node;
+
+    matches = node && node->nextcount == 2 - i &&
+              record->size == s_Sizes[i] &&
+              strlen(record->data) == s_Sizes[i];
+    node    = node ? node->next : NULL;
+  }
+
+  return matches && !node;
+}
+
+static size_t Records_CountLines(FILE* file)
+{
+  size_t lines = 0;
+  int    c;
+
+  rewind(file);
+
+  while ((c = getc(file)) != EOF)
+  {
+    lines += (c == '\n');
+  }
+
+  return lines;
+}
+
+static void Records_Test()
+{
+  static const char s_Delimiters[] = { '\n', '\0' };
+
+  RecordBatch batch;
+  MetaList    list;
+  size_t      i;
+
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+  fprintf(g_FileOut, "/* Records_Test (--test=5)                                           */\n");
+  fprintf(g_FileOut, "/*   - Checks --records across blocks, with and without --window.    */\n");
+  fprintf(g_FileOut, "/*********************************************************************/\n");
+
+  for (i = 0; i < sizeof(s_Delimiters); ++i)
+  {
+    FILE* fin  = Records_WriteSample(s_Delimiters[i]);
+    FILE* sink = tmpfile();
+
+    if (!TEST_CHECK(fin && sink))
+    {
+      if (fin)
+        fclose(fin);
+      if (sink)
+        fclose(sink);
+      return;
+    }
+
+    /* Unwindowed, the whole chain is handed over in one push. */
+    MetaList_Construct(&list);
+    RecordBatch_Construct(&batch, &list, 0u, sink);
+    RecordBatch_Read(&batch, fin, s_Delimiters[i]);
+    TEST_CHECK(Records_MatchSample(&list));
+    MetaList_Clear(&list);
+
+    /* Windowed, every record is printed and the list is left empty. */
+    rewind(fin);
+    RecordBatch_Construct(&batch, &list, 2u, sink);
+    RecordBatch_Read(&batch, fin, s_Delimiters[i]);
+    TEST_CHECK(list.size == 0 && !list.head && Records_CountLines(sink) == 3);
+
+    fclose(sink);
+    fclose(fin);
+  }
+
+  /* Each flush empties the window list, the last one included. */
+  RecordBatch_Construct(&batch, &list, 2u, NULL);
+  batch.fout = tmpfile();
+
+  if (!TEST_CHECK(batch.fout != NULL))
+  {
+    return;
+  }
+
+  RecordBatch_Add(&batch, "a", 1);
+  TEST_CHECK(list.size == 0 && batch.count == 1);
+  RecordBatch_Add(&batch, "b", 1);
+  TEST_CHECK(list.size == 0 && !list.head && batch.count == 0);
+  RecordBatch_Add(&batch, "c", 1);
+  RecordBatch_Flush(&batch);
+  TEST_CHECK(list.size == 0 && !list.head && Records_CountLines(batch.fout) == 3);
+
+  fclose(batch.fout);
+}
+
+static void RunTests()
+{
+  static const TestFunction s_Tests[] =
+  {
+    BString_Test,
+    Format_Test,
+    MetaPool_Test,
+    Pack_Test,
+    BitStats_Test,
+    Records_Test
+  };
+
+  size_t   count = sizeof(s_Tests) / sizeof(TestFunction);
+  BString* arg   = g_Inputs[OPT_CODE_TEST].optarg;
+
+  if (arg)
+  {
+    int idx = atoi(arg->data);
+
+    if (idx >= 0 && idx < count)
     {
       s_Tests[idx]();
     }
@@ -737,10 +2882,11 @@ static void RunTests()
 
 
 /*********************************************************************/
-/* PUBLIC */                /* FUNCTIONS */                  /* MAIN */
+/* PRIVATE */              /* FUNCTIONS */           /* COMMAND LINE */
 /*********************************************************************/
 
-int main(int argc, char* const* argv)
+/* Returns FALSE if the command line was fully handled while parsing. */
+static bool ParseCommandLine(int argc, char* const* argv)
 {
   static const struct option s_LongOptions[] =
   {
@@ -750,82 +2896,508 @@ int main(int argc, char* const* argv)
     { "out",           required_argument,    NULL,                        'o' },
     { "hang",          no_argument,          NULL,                        '0' },
     { "test",          optional_argument,    NULL,                        't' },
+    { "serve",         optional_argument,    NULL,                        's' },
+    { "fatal",         required_argument,    NULL,                        'f' },
+    { "dump",          required_argument,    NULL,                        'd' },
+    { "out-format",    required_argument,    NULL,                        'F' },
+    { "expand",        required_argument,    NULL,                        'x' },
+    { "bitstats",      required_argument,    NULL,                        'b' },
+    { "threads",       required_argument,    NULL,                        'j' },
+    { "bitdiff",       required_argument,    NULL,                        'D' },
+    { "records",       required_argument,    NULL,                        'r' },
+    { "nul",           no_argument,          NULL,                        'z' },
+    { "window",        required_argument,    NULL,                        'w' },
     { NULL,            0,                    NULL,                         0  }
   };
 
-  if (argc > 1)
+  while (TRUE)
   {
-    InitGlobalMemory(argv[0]);
-    
-    bool run_tests = FALSE;
+    size_t    len         = 0;
+    int       opt_idx     = 0;
+    int       opt         = getopt_long(argc, argv, "-:hvo:0t::s::f:d:F:x:b:j:D:r:zw:",
+                                        s_LongOptions, &opt_idx);
 
-    while (TRUE)
-    {
-      size_t    len         = 0;
-      int       opt_idx     = 0;
-      int       opt         = getopt_long(argc, argv, "-:hvo:0t::",
-                                          s_LongOptions, &opt_idx);
+    if (opt == -1)
+      break;
 
-      if (opt == -1)
+    switch (opt)
+    {
+      case 0:
+        /* Long options where flag is not NULL. */
         break;
-
-      switch (opt)
-      {
-        case 0:
-          /* Long options where flag is not NULL. */
-          break;
-        case 1:
-          /* Loose, non-option arguments. */
-          len = strlen(optarg);
-          if (len)
-          {
-            MetaList_PushBack(&g_NonOptionArgumentStrings,
-                              (MetaObjectPtr)BString_Create(optarg, len));
-          }
-          break;
-        case 'h':
-          /* --help */
-          PrintHelp();
-          FreeGlobalMemory();
-          return g_CurrentErrors;
-        case 'v':
-          PrintVersion();
-          FreeGlobalMemory();
-          return g_CurrentErrors;
-        case ':':
-          /* Required arguments to options are missing. */
-          printf("<ERR> Required arguments to some options are missing.\n");
+      case 1:
+        /* Loose, non-option arguments. */
+        len = strlen(optarg);
+        if (len)
+        {
+          MetaList_PushBack(&g_NonOptionArgumentStrings,
+                            (MetaObjectPtr)BString_Create(optarg, len));
+        }
+        break;
+      case 'h':
+        /* --help */
+        PrintHelp(g_FileDefault);
+        return FALSE;
+      case 'v':
+        PrintVersion(g_FileDefault);
+        return FALSE;
+      case ':':
+        /* Required arguments to options are missing. */
+        fprintf(g_FileDefault, "<ERR> Required arguments to some options are missing.\n");
+        Throw(ERR_CODE_BAD_CLI, __FUNCTION__, __LINE__);
+        return FALSE;
+      case '?':
+        /* Unknown option. */
+        fprintf(g_FileDefault, "<ERR> Unknown option entered.\n");
+        Throw(ERR_CODE_BAD_CLI, __FUNCTION__, __LINE__);
+        return FALSE;
+      case 'o':
+        /* --out=FILE */
+        SetOutFile(optarg);
+        break;
+      case '0':
+        fprintf(g_FileDefault, "Nice job bb hon! But do you know how to *stop* hanging? o.O\n");
+        Hang();
+        break;
+      case 't':
+        OptionInput_Set(&g_Inputs[OPT_CODE_TEST], optarg);
+        break;
+      case 's':
+        if (g_InRequest)
+        {
+          fprintf(g_FileDefault, "<ERR> --serve cannot be nested inside a request.\n");
+          Throw(ERR_CODE_BAD_CLI, __FUNCTION__, __LINE__);
+          return FALSE;
+        }
+        OptionInput_Set(&g_Inputs[OPT_CODE_SERVE], optarg);
+        break;
+      case 'f':
+        /* --fatal=WHICH */
+        if (!SetFatalMask(optarg))
+        {
+          fprintf(g_FileDefault, "<ERR> Unknown --fatal policy \"%s\".\n", optarg);
+          Throw(ERR_CODE_BAD_CLI, __FUNCTION__, __LINE__);
+          return FALSE;
+        }
+        break;
+      case 'd':
+        /* --dump=FILE */
+        if (!CheckInputFile("dump", optarg))
+        {
+          return FALSE;
+        }
+        OptionInput_Set(&g_Inputs[OPT_CODE_DUMP], optarg);
+        break;
+      case 'F':
+        /* --out-format=WHICH */
+        if (strcmp(optarg, "text") && strcmp(optarg, "packed"))
+        {
+          fprintf(g_FileDefault, "<ERR> Unknown --out-format \"%s\".\n", optarg);
+          Throw(ERR_CODE_BAD_CLI, __FUNCTION__, __LINE__);
+          return FALSE;
+        }
+        OptionInput_Set(&g_Inputs[OPT_CODE_FORMAT], optarg);
+        break;
+      case 'x':
+        /* --expand=FILE */
+        if (!CheckInputFile("expand", optarg))
+        {
+          return FALSE;
+        }
+        OptionInput_Set(&g_Inputs[OPT_CODE_EXPAND], optarg);
+        break;
+      case 'b':
+        /* --bitstats=FILE */
+        OptionInput_Set(&g_Inputs[OPT_CODE_BITSTATS], optarg);
+        break;
+      case 'j':
+        /* --threads=N */
+        if (atoi(optarg) < 1)
+        {
+          fprintf(g_FileDefault, "<ERR> --threads needs a positive count.\n");
+          Throw(ERR_CODE_BAD_CLI, __FUNCTION__, __LINE__);
+          return FALSE;
+        }
+        OptionInput_Set(&g_Inputs[OPT_CODE_THREADS], optarg);
+        break;
+      case 'D':
+        /* --bitdiff A B: B is taken straight from the next argument. */
+        if (optind >= argc || argv[optind][0] == '-')
+        {
+          fprintf(g_FileDefault, "<ERR> --bitdiff needs two files.\n");
           Throw(ERR_CODE_BAD_CLI, __FUNCTION__, __LINE__);
-          return g_CurrentErrors;
-        case '?':
-          /* Unknown option. */
-          printf("<ERR> Unknown option entered.");
+          return FALSE;
+        }
+        OptionInput_Set(&g_Inputs[OPT_CODE_BITDIFF], optarg);
+        OptionInput_Set(&g_Inputs[OPT_CODE_BITDIFF2], argv[optind++]);
+        break;
+      case 'r':
+        /* --records=FILE */
+        if (!CheckInputFile("records", optarg))
+        {
+          return FALSE;
+        }
+        OptionInput_Set(&g_Inputs[OPT_CODE_RECORDS], optarg);
+        break;
+      case 'z':
+        /* --nul */
+        OptionInput_Set(&g_Inputs[OPT_CODE_NUL], NULL);
+        break;
+      case 'w':
+        /* --window=N */
+        if (atol(optarg) < 1)
+        {
+          fprintf(g_FileDefault, "<ERR> --window needs a positive record count.\n");
           Throw(ERR_CODE_BAD_CLI, __FUNCTION__, __LINE__);
-          return g_CurrentErrors;
-        case 'o':
-          /* --out=FILE */
-          SetOutFile(optarg);
-          break;
-        case '0':
-          printf("Nice job bb hon! But do you know how to *stop* hanging? o.O\n");
-          Hang();
-          break;
-        case 't':
-          run_tests = TRUE;
-          break;
+          return FALSE;
+        }
+        OptionInput_Set(&g_Inputs[OPT_CODE_WINDOW], optarg);
+        break;
+    }
+  }
+
+  return TRUE;
+}
+
+static bool RunCommandLine(int argc, char* const* argv)
+{
+  if (!ParseCommandLine(argc, argv))
+  {
+    return FALSE;
+  }
+
+  if (g_Inputs[OPT_CODE_RECORDS].input)
+  {
+    BString* window = g_Inputs[OPT_CODE_WINDOW].optarg;
+
+    ReadRecords(g_Inputs[OPT_CODE_RECORDS].optarg->data,
+                g_Inputs[OPT_CODE_NUL].input ? '\0' : '\n',
+                window ? (size_t)atol(window->data) : 0u);
+  }
+
+  if (g_Inputs[OPT_CODE_TEST].input)
+  {
+    RunTests();
+  }
+
+  if (g_Inputs[OPT_CODE_DUMP].input)
+  {
+    BString* format = g_Inputs[OPT_CODE_FORMAT].optarg;
+
+    Dump(g_Inputs[OPT_CODE_DUMP].optarg->data,
+         format && !strcmp(format->data, "packed"));
+  }
+
+  if (g_Inputs[OPT_CODE_EXPAND].input)
+  {
+    Expand(g_Inputs[OPT_CODE_EXPAND].optarg->data);
+  }
+
+  if (g_Inputs[OPT_CODE_BITSTATS].input)
+  {
+    ReportBitStats(g_Inputs[OPT_CODE_BITSTATS].optarg->data);
+  }
+
+  if (g_Inputs[OPT_CODE_BITDIFF].input)
+  {
+    ReportBitDiff(g_Inputs[OPT_CODE_BITDIFF].optarg->data,
+                  g_Inputs[OPT_CODE_BITDIFF2].optarg->data);
+  }
+
+  return TRUE;
+}
+
+
+
+/*********************************************************************/
+/* PRIVATE */              /* FUNCTIONS */                  /* SERVE */
+/*********************************************************************/
+
+#define SERVE_MAX_ARGS        64
+#define SERVE_SOCKET_BACKLOG  8
+
+static bool Serve_ReadLine(FILE* fin, BString* line)
+{
+  int c = getc(fin);
+
+  BString_Clear(line);
+
+  if (c == EOF)
+  {
+    return FALSE;
+  }
+
+  while (c != EOF && c != '\n')
+  {
+    BString_PushBackChar(line, (char)c);
+    c = getc(fin);
+  }
+
+  return TRUE;
+}
+
+/* Splits line in place on blanks; "double quotes" keep blanks together. */
+static int Serve_SplitLine(char* line, char** argv, int max_args)
+{
+  int   argc = 1;
+  char* read = line;
+
+  while (*read)
+  {
+    char* write;
+    bool  quoted = FALSE;
+    bool  more;
+
+    while (*read == ' ' || *read == '\t' || *read == '\r')
+    {
+      ++read;
+    }
+
+    if (!*read)
+    {
+      break;
+    }
+
+    if (argc == max_args)
+    {
+      fprintf(g_FileDefault, "<ERR> More than %d arguments in one request.\n", max_args - 1);
+      Throw(ERR_CODE_BAD_CLI, __FUNCTION__, __LINE__);
+      break;
+    }
+
+    argv[argc++] = write = read;
+
+    while (*read && (quoted || (*read != ' ' && *read != '\t' && *read != '\r')))
+    {
+      if (*read == '"')
+      {
+        quoted = !quoted;
+      }
+      else
+      {
+        *write++ = *read;
       }
+
+      ++read;
+    }
+
+    more   = (*read != '\0');
+    *write = '\0';
+
+    if (more)
+    {
+      ++read;
+    }
+  }
+
+  argv[argc] = NULL;
+  return argc;
+}
+
+static void Serve_Dispatch(char* line, const char* argv0)
+{
+  static char* s_Argv[SERVE_MAX_ARGS + 1];
+
+  int argc;
+
+  s_Argv[0] = (char*)argv0;
+  argc      = Serve_SplitLine(line, s_Argv, SERVE_MAX_ARGS);
+
+  if (argc > 1)
+  {
+    RunCommandLine(argc, s_Argv);
+  }
+}
+
+/* Runs one request against freshly reset per-request state. */
+static int Serve_RunRequest(BString* line, const char* argv0)
+{
+  FreeGlobalMemory();
+  g_CurrentErrors = 0;
+  g_FatalMask     = g_FatalMaskDefault;
+  optind          = 0; /* glibc: fully reinitialize getopt */
+  InitGlobalMemory(argv0);
+
+  g_InRequest = TRUE;
+
+  if (!setjmp(g_RequestJump))
+  {
+    Serve_Dispatch(line->data, argv0);
+
+    /* A client that hung up fails its request (EPIPE) and nothing else. */
+    if (fflush(g_FileDefault) == EOF || ferror(g_FileDefault))
+    {
+      Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    }
+  }
+
+  g_InRequest = FALSE;
+
+  Errors_Drain(g_FileDefault);
+
+  if (g_FileOut)
+  {
+    fflush(g_FileOut);
+  }
+
+  fflush(g_FileDefault);
+  fflush(stdout);
+  return g_CurrentErrors;
+}
+
+static int Serve_Stream(FILE* fin, const char* argv0)
+{
+  int      errors = 0;
+  BString* line   = BString_Create(NULL, 0);
+
+  while (line && Serve_ReadLine(fin, line))
+  {
+    errors |= Serve_RunRequest(line, argv0);
+  }
+
+  /* Release the last request before its sink can go away. */
+  FreeGlobalMemory();
+  BString_Dispose((void**)&line);
+  return errors;
+}
+
+static int Serve_Socket(const char* path, const char* argv0)
+{
+  struct sockaddr_un addr;
+  struct stat        info;
+
+  FILE* sink     = g_FileDefault;
+  int   errors   = 0;
+  int   listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (listener < 0 || strlen(path) >= sizeof(addr.sun_path))
+  {
+    Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    return g_CurrentErrors;
+  }
+
+  /* Only ever replace a stale socket, never some other file. */
+  if (!lstat(path, &info) && !S_ISSOCK(info.st_mode))
+  {
+    close(listener);
+    Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    return g_CurrentErrors;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+
+  if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(listener, SERVE_SOCKET_BACKLOG) < 0)
+  {
+    close(listener);
+    Throw(ERR_CODE_BAD_FILE, __FUNCTION__, __LINE__);
+    return g_CurrentErrors;
+  }
+
+  /* Writes to a client that went away must fail, not kill the server. */
+  signal(SIGPIPE, SIG_IGN);
+
+  while (TRUE)
+  {
+    FILE* fin;
+    FILE* fout;
+    int   client = accept(listener, NULL, NULL);
+
+    if (client < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    /* Each client's requests write back to the client by default. */
+    fin  = fdopen(client, "r");
+    fout = fin ? fdopen(dup(client), "w") : NULL;
+
+    if (fin && fout)
+    {
+      g_FileDefault = fout;
+      errors |= Serve_Stream(fin, argv0);
+      g_FileDefault = sink;
+    }
+
+    if (fout)
+    {
+      fclose(fout);
+    }
+
+    if (fin)
+    {
+      fclose(fin);
+    }
+    else
+    {
+      close(client);
     }
+  }
+
+  close(listener);
+  unlink(path);
+  return errors;
+}
+
+static void Serve(const char* argv0)
+{
+  BString* socket_path = g_Inputs[OPT_CODE_SERVE].optarg;
+  int      errors      = g_CurrentErrors;
+
+  /* The serving command line's --out outlives every request. */
+  g_Inputs[OPT_CODE_SERVE].optarg = NULL;
+  g_FileDefault                   = g_FileOut;
+  g_FatalMaskDefault              = g_FatalMask;
+
+  if (!socket_path || !strcmp(socket_path->data, "-"))
+  {
+    g_ServingStdin = TRUE;
+    errors |= Serve_Stream(stdin, argv0);
+    g_ServingStdin = FALSE;
+  }
+  else
+  {
+    errors |= Serve_Socket(socket_path->data, argv0);
+  }
+
+  /* Hand the serving sink back so FreeGlobalMemory closes it. */
+  g_FileOut       = g_FileDefault;
+  g_FileDefault   = stdout;
+  g_FatalMask     = g_FatalMaskDefault;
+  g_CurrentErrors = errors;
+
+  BString_Dispose((void**)&socket_path);
+}
+
+
+
+/*********************************************************************/
+/* PUBLIC */                /* FUNCTIONS */                  /* MAIN */
+/*********************************************************************/
+
+int main(int argc, char* const* argv)
+{
+  if (argc > 1)
+  {
+    InitGlobalMemory(argv[0]);
 
-    if (run_tests)
+    if (RunCommandLine(argc, argv) && g_Inputs[OPT_CODE_SERVE].input)
     {
-      RunTests();
+      Serve(argv[0]);
     }
 
+    Errors_Drain(g_FileDefault);
     FreeGlobalMemory();
+    MetaPools_Release();
   }
   else
   {
-    PrintHelp();
+    PrintHelp(stdout);
   }
 
   return g_CurrentErrors;